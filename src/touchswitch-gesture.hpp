@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cmath>
+
+/* Distance in pixels a press must move before it drags the switcher */
+static constexpr double TOUCHSWITCH_DRAG_DEADZONE = 40.0;
+/* Distance in pixels from the press at which a drag picks its axis */
+static constexpr double TOUCHSWITCH_SWIPE_COMMIT = 50.0;
+/* Speed in px/ms at which a flick is considered stopped */
+static constexpr double TOUCHSWITCH_VELOCITY_THRESHOLD = 0.1;
+/* Release speed in px/ms needed for a flick */
+static constexpr double TOUCHSWITCH_FLICK_VELOCITY_MIN = 0.5;
+/* Age in ms of the oldest motion sample used for the release velocity */
+static constexpr double TOUCHSWITCH_FLICK_WINDOW_MS = 100.0;
+
+/* Axis a drag has committed to */
+enum class touchswitch_swipe_t
+{
+    UNDECIDED,
+    VERTICAL,
+    HORIZONTAL,
+};
+
+/* Whether a drag (dx, dy) away from the press has left the dead zone */
+inline bool touchswitch_left_deadzone(double dx, double dy)
+{
+    return std::hypot(dx, dy) > TOUCHSWITCH_DRAG_DEADZONE;
+}
+
+/**
+ * Decide the axis of a drag which is (dx, dy) away from its press. Once an
+ * axis is picked it is kept until the finger lifts.
+ */
+inline touchswitch_swipe_t touchswitch_classify_swipe(touchswitch_swipe_t current,
+    double dx, double dy)
+{
+    if ((current != touchswitch_swipe_t::UNDECIDED) ||
+        (std::hypot(dx, dy) <= TOUCHSWITCH_SWIPE_COMMIT))
+    {
+        return current;
+    }
+
+    if (std::abs(dy) > std::abs(dx))
+    {
+        return touchswitch_swipe_t::VERTICAL;
+    }
+
+    return touchswitch_swipe_t::HORIZONTAL;
+}
+
+/* Whether a vertical drag of dy on a slot pulls it far enough for the
+ * pull up or pull down action, a quarter of the workarea height */
+inline bool touchswitch_pulled(double dy, double workarea_height)
+{
+    return std::abs(dy) > (workarea_height / 4.0);
+}
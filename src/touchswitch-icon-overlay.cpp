@@ -293,6 +293,9 @@ class touchswitch_icon_overlay_node_t : public node_t
      * Set in the pre-render hook and used in the render function. */
     bool overlay_shown = false;
     wf::wl_idle_call idle_update_icon;
+    /* Result of the last dialog tree walk, valid for cached_generation */
+    bool cached_has_overlay = false;
+    uint64_t cached_generation = 0;
 
   private:
     /**
@@ -336,6 +339,11 @@ class touchswitch_icon_overlay_node_t : public node_t
             return false;
         }
 
+        if (cached_generation == this->parent.tree_generation)
+        {
+            return cached_has_overlay;
+        }
+
         auto parent = find_topmost_parent(view);
 
         while (!parent->children.empty())
@@ -343,7 +351,9 @@ class touchswitch_icon_overlay_node_t : public node_t
             parent = parent->children[0];
         }
 
-        return view == parent;
+        cached_generation  = this->parent.tree_generation;
+        cached_has_overlay = (view == parent);
+        return cached_has_overlay;
     }
 
     void update_app_id()
@@ -509,6 +519,7 @@ touchswitch_show_icon_t::touchswitch_show_icon_t() :
 
 add_icon_overlay{[this] (touchswitch_transformer_added_signal *signal)
     {
+        tree_generation++;
         using namespace wf::scene;
 
         const std::string& pos_opt = icon_position;
@@ -531,14 +542,27 @@ add_icon_overlay{[this] (touchswitch_transformer_added_signal *signal)
         auto parent = std::dynamic_pointer_cast<wf::scene::floating_inner_node_t>(
             tr->parent()->shared_from_this());
 
-        auto node = std::make_shared<touchswitch_icon_overlay_node_t>(signal->view, pos, *this);
+        /* Put back the node kept from the last activation, with its texture */
+        std::shared_ptr<touchswitch_icon_overlay_node_t> node;
+        auto kept = standby_nodes.find(signal->view);
+        if (kept != standby_nodes.end())
+        {
+            node = kept->second;
+            standby_nodes.erase(kept);
+        } else
+        {
+            node = std::make_shared<touchswitch_icon_overlay_node_t>(signal->view, pos, *this);
+        }
+
         wf::scene::add_front(parent, node);
         wf::scene::damage_node(parent, parent->get_bounding_box());
     }
 },
 
-rem_icon_overlay{[] (touchswitch_transformer_removed_signal *signal)
+rem_icon_overlay{[this] (touchswitch_transformer_removed_signal *signal)
     {
+        tree_generation++;
+        standby_nodes.erase(signal->view);
         using namespace wf::scene;
         node_t *tr = signal->view->get_transformed_node()->get_transformer(TOUCHSWITCH_TRANSFORMER).get();
 
@@ -556,6 +580,41 @@ rem_icon_overlay{[] (touchswitch_transformer_removed_signal *signal)
             tr = tr->parent();
         }
     }
+},
+
+standby_icon_overlay{[this] (touchswitch_transformer_standby_signal *signal)
+    {
+        tree_generation++;
+        using namespace wf::scene;
+        node_t *tr = signal->view->get_transformed_node()->get_transformer(TOUCHSWITCH_TRANSFORMER).get();
+
+        while (tr)
+        {
+            for (auto& ch : tr->get_children())
+            {
+                if (auto node = std::dynamic_pointer_cast<touchswitch_icon_overlay_node_t>(ch))
+                {
+                    standby_nodes[signal->view] = node;
+                    remove_child(ch);
+                    break;
+                }
+            }
+
+            tr = tr->parent();
+        }
+    }
+},
+
+prefetch_icon{[this] (touchswitch_prefetch_signal *signal)
+    {
+        /* Look up and rasterize the icon now, so it is ready when the slot is reached */
+        auto view = wf::find_topmost_parent(signal->view);
+        if (show_view_icon_overlay && !view->has_data<view_icon_texture_t>())
+        {
+            view->store_data<view_icon_texture_t>(std::make_unique<view_icon_texture_t>(
+                view, output->handle->scale));
+        }
+    }
 }
 {}
 
@@ -564,6 +623,8 @@ void touchswitch_show_icon_t::init(wf::output_t *output)
     this->output = output;
     output->connect(&add_icon_overlay);
     output->connect(&rem_icon_overlay);
+    output->connect(&standby_icon_overlay);
+    output->connect(&prefetch_icon);
     output->connect(&touchswitch_end);
     output->connect(&touchswitch_update);
 
@@ -2,6 +2,8 @@
 
 #include "wayfire/signal-definitions.hpp"
 #include "wayfire/signal-provider.hpp"
+#include <map>
+#include <memory>
 #include <string>
 
 #include <wayfire/plugin.hpp>
@@ -40,6 +42,8 @@ class touchswitch_show_icon_t
     wf::signal::connection_t<touchswitch_update_signal> touchswitch_update;
     wf::signal::connection_t<touchswitch_transformer_added_signal> add_icon_overlay;
     wf::signal::connection_t<touchswitch_transformer_removed_signal> rem_icon_overlay;
+    wf::signal::connection_t<touchswitch_transformer_standby_signal> standby_icon_overlay;
+    wf::signal::connection_t<touchswitch_prefetch_signal> prefetch_icon;
 
     friend class wf::scene::touchswitch_icon_overlay_node_t;
 
@@ -47,4 +51,11 @@ class touchswitch_show_icon_t
     /* only used if title overlay is set to follow the mouse */
 
     void update_icon_overlay_opt();
+
+    /* Bumped whenever a transformer is added or removed, so overlay nodes
+     * know when the dialog trees they depend on may have changed */
+    uint64_t tree_generation = 0;
+
+    /* Overlay nodes taken out of the scene while their view is in standby */
+    std::map<wayfire_toplevel_view, std::shared_ptr<wf::scene::touchswitch_icon_overlay_node_t>> standby_nodes;
 };
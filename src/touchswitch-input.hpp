@@ -0,0 +1,463 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "touchswitch-gesture.hpp"
+#include "touchswitch-layout.hpp"
+#include "touchswitch-physics.hpp"
+
+/* A position in the coordinates input events arrive in */
+struct touchswitch_point_t
+{
+    double x = 0.0;
+    double y = 0.0;
+};
+
+/* Options read by the input handling */
+struct touchswitch_input_config_t
+{
+    /* touchswitch/flick_motion */
+    double flick_motion = 0.98;
+    /* touchswitch/touch_prediction and touchswitch/touch_prediction_max */
+    bool touch_prediction = false;
+    double touch_prediction_max = 40.0;
+};
+
+/**
+ * What the input state machine needs from the switcher around it. The
+ * plugin implements it on top of wayfire, and touchswitch-replay with a
+ * simulated output and frame clock.
+ */
+class touchswitch_input_host_t
+{
+  public:
+    virtual ~touchswitch_input_host_t() = default;
+
+    /* Current time in ms, in the clock input events are stamped with */
+    virtual double get_current_time() = 0;
+    /* Length of a frame on the output in ms */
+    virtual double get_frame_ms() = 0;
+    virtual touchswitch_input_config_t get_input_config() = 0;
+    virtual size_t get_slot_count() = 0;
+    /* The layout engine, configured for the current workarea */
+    virtual const touchswitch_layout_t& get_input_layout() = 0;
+    virtual double get_workarea_height() = 0;
+
+    /* Remember the slot under a press as the target of its release, or
+     * none if the press is on the background */
+    virtual void select_slot_at(touchswitch_point_t at) = 0;
+    /* The scroll or pull offsets changed, lay the slots out again */
+    virtual void relayout() = 0;
+    /* A vertical drag or flick on the selected slot ended pulled far
+     * enough for the pull up (dy < 0) or pull down action */
+    virtual void slot_pulled(double dy) = 0;
+    /* A press was released without leaving the dead zone */
+    virtual void tapped() = 0;
+    /* A flick was released and is expected to come to rest on this slot */
+    virtual void flick_predicted(size_t slot)
+    {}
+    /* A flick came to rest, on the slot predicted at release or not */
+    virtual void flick_stopped(bool as_predicted)
+    {}
+};
+
+/**
+ * Press, motion, release and per-frame handling of the switcher: deciding
+ * the drag axis, scrolling and pulling slots, flicks with their release
+ * velocity and landing prediction, and touch prediction while dragging.
+ *
+ * It needs no wayfire, so traces can be replayed through the same code the
+ * plugin runs.
+ */
+class touchswitch_input_t
+{
+    touchswitch_input_host_t& host;
+    touchswitch_point_t last_touch, start_touch;
+    /* Recent motion samples of the current touch or drag */
+    touchswitch_motion_tracker_t motion_samples;
+    /* Latest motion event not yet applied to the layout */
+    bool motion_pending = false;
+    touchswitch_point_t pending_motion;
+    double pending_motion_time = 0;
+    /* Extrapolated finger motion currently included in the slot positions */
+    touchswitch_point_t applied_prediction;
+
+  public:
+    /* The point at which movement is considered stopped, and velocity is zeroed */
+    static constexpr double VELOCITY_THRESHOLD = TOUCHSWITCH_VELOCITY_THRESHOLD;
+    /* Age of the oldest motion sample used for touch prediction */
+    static constexpr double PREDICTION_WINDOW_MS = 50.0;
+
+    /* Selected slot, fractional while scrolling, NaN for none */
+    double touch_x_offset = std::numeric_limits<double>::quiet_NaN();
+    /* How far the selected slot is pulled up or down */
+    double touch_y_offset = 0.0;
+    touchswitch_velocity_t velocity;
+    touchswitch_swipe_t swipe_direction = touchswitch_swipe_t::UNDECIDED;
+    bool touch_held = false;
+    /* Time in ms up to which a flick has been integrated */
+    double flick_timestamp = 0;
+    /* Slot a flick is predicted to land on, or -1 when not flicking */
+    long predicted_index = -1;
+    /* Presentation time of the last displayed frame and the interval between
+     * displayed frames, in the same millisecond clock as input events */
+    double last_present_ms     = 0;
+    double present_interval_ms = 0;
+
+    explicit touchswitch_input_t(touchswitch_input_host_t& host) : host(host)
+    {}
+
+    /* Stop any drag or flick, keeping the selection */
+    void stop()
+    {
+        velocity = {};
+        flick_timestamp = 0;
+        predicted_index = -1;
+        swipe_direction = touchswitch_swipe_t::UNDECIDED;
+        touch_y_offset  = 0.0;
+    }
+
+    /* Forget everything about the input of the last activation */
+    void reset()
+    {
+        stop();
+        touch_held = false;
+        motion_pending = false;
+        motion_samples.clear();
+        applied_prediction = {};
+        last_touch  = {};
+        start_touch = {};
+        touch_x_offset = std::numeric_limits<double>::quiet_NaN();
+    }
+
+    /* Helper to end swipe velocity */
+    bool is_velocity_zero()
+    {
+        if (std::hypot(velocity.x, velocity.y) > VELOCITY_THRESHOLD)
+        {
+            return false;
+        }
+
+        velocity = {};
+        return true;
+    }
+
+    /* Whether the slots follow the input directly instead of animating */
+    bool is_tracking()
+    {
+        return touch_held || !is_velocity_zero();
+    }
+
+    /* Whether motion is waiting for the next frame */
+    bool has_pending_motion() const
+    {
+        return motion_pending;
+    }
+
+    /**
+     * Record a motion event. Several events can arrive per frame, so they
+     * are only recorded here, and the latest position is applied once per
+     * frame by flush_motion().
+     *
+     * @return Whether the motion was taken, which is while pressed.
+     */
+    bool motion(double time, touchswitch_point_t to)
+    {
+        if (!touch_held)
+        {
+            return false;
+        }
+
+        motion_samples.add(time, to.x, to.y);
+        pending_motion = to;
+        pending_motion_time = time;
+        motion_pending = true;
+        return true;
+    }
+
+    /* Apply the motion accumulated since the last frame */
+    void flush_motion()
+    {
+        if (!motion_pending)
+        {
+            return;
+        }
+
+        motion_pending = false;
+        auto to = pending_motion;
+        if (touchswitch_left_deadzone(to.x - start_touch.x, to.y - start_touch.y))
+        {
+            /* Check if we've commited to a gesture */
+            swipe_direction = touchswitch_classify_swipe(swipe_direction,
+                to.x - start_touch.x, to.y - start_touch.y);
+            if (swipe_direction == touchswitch_swipe_t::UNDECIDED)
+            {
+                /* Keep the motion until there is an axis to apply it to, so
+                 * where frames fall does not change how far the drag goes */
+                return;
+            }
+
+            handle_relative_motion({to.x - last_touch.x, to.y - last_touch.y},
+                pending_motion_time);
+            last_touch = to;
+        }
+    }
+
+    /* Process a press or release */
+    void button(bool pressed, double time, touchswitch_point_t at)
+    {
+        /* Motion queued for this frame happened before this event */
+        flush_motion();
+        last_touch  = at;
+        start_touch = at;
+
+        if (pressed)
+        {
+            swipe_direction = touchswitch_swipe_t::UNDECIDED;
+            touch_held = true;
+            velocity   = {};
+            flick_timestamp = 0;
+            motion_samples.clear();
+            motion_samples.add(time, at.x, at.y);
+            applied_prediction = {};
+            host.select_slot_at(at);
+            return;
+        }
+
+        touch_held = false;
+
+        /* Drag or touch left the dead zone */
+        if (swipe_direction != touchswitch_swipe_t::UNDECIDED)
+        {
+            /* Take back the extrapolated motion, the finger is where it lifted */
+            if ((applied_prediction.x != 0) || (applied_prediction.y != 0))
+            {
+                touchswitch_point_t undo = {-applied_prediction.x, -applied_prediction.y};
+                applied_prediction = {};
+                handle_relative_motion(undo, time);
+            }
+
+            /* Estimate the release velocity from the recent motion samples */
+            motion_samples.add(time, at.x, at.y);
+            auto estimate = motion_samples.estimate(time, TOUCHSWITCH_FLICK_WINDOW_MS);
+            if (std::hypot(estimate.x, estimate.y) <= TOUCHSWITCH_FLICK_VELOCITY_MIN)
+            {
+                /* Touch ended and not registered as a flick */
+                velocity = {};
+                flick_timestamp = 0;
+                touch_x_offset  = std::round(touch_x_offset);
+                handle_window_swipe();
+                touch_y_offset = 0.0;
+            } else
+            {
+                /* Touch was a flick on release */
+                flick_timestamp = time;
+                velocity = estimate;
+                predict_flick_landing();
+            }
+
+            motion_samples.clear();
+            last_touch  = {};
+            start_touch = {};
+            host.relayout();
+            return;
+        }
+
+        /* Didn't leave the dead zone, it is 'just' a touch */
+        host.tapped();
+    }
+
+    /**
+     * Track when frames are actually shown, to drive the flick integrator.
+     *
+     * @return How many frames were not displayed on time while a flick was
+     *   moving.
+     */
+    uint64_t presented(double present_ms, double interval)
+    {
+        uint64_t missed = 0;
+        bool flicking   = !touch_held && (std::hypot(velocity.x, velocity.y) > VELOCITY_THRESHOLD);
+        if (flicking && (last_present_ms > 0) && (present_ms - last_present_ms > 1.5 * interval))
+        {
+            missed = (uint64_t)std::round((present_ms - last_present_ms) / interval) - 1;
+        }
+
+        last_present_ms     = present_ms;
+        present_interval_ms = interval;
+        return missed;
+    }
+
+    /* Advance a flick to the frame being rendered, called once per frame */
+    void step_flick()
+    {
+        if (touch_held || is_velocity_zero())
+        {
+            return;
+        }
+
+        /* Apply friction over the time since the last frame. The decay is
+         * integrated exactly, so the flick covers the same distance at any
+         * refresh rate or with dropped frames */
+        auto config = host.get_input_config();
+        double frame_time = get_next_frame_time();
+        double count_msec = std::max(frame_time - flick_timestamp, 0.0);
+        flick_timestamp = frame_time;
+
+        auto step = touchswitch_flick_step(config.flick_motion, count_msec);
+        touchswitch_point_t movement = {velocity.x * step.distance, velocity.y * step.distance};
+        velocity = {velocity.x * step.decay, velocity.y * step.decay};
+        if (std::hypot(velocity.x, velocity.y) <= VELOCITY_THRESHOLD)
+        {
+            /* Finish with the distance the remaining velocity would still coast */
+            movement.x += touchswitch_flick_tail(velocity.x, config.flick_motion);
+            movement.y += touchswitch_flick_tail(velocity.y, config.flick_motion);
+        }
+
+        handle_relative_motion(movement, frame_time);
+        if (is_velocity_zero() || touchswitch_pulled(touch_y_offset, host.get_workarea_height()))
+        {
+            /* Was moving, now isn't. */
+            handle_window_swipe(); /* Account for actions on vertical swipe */
+            swipe_direction = touchswitch_swipe_t::UNDECIDED;
+            touch_x_offset  = std::round(touch_x_offset);
+            host.flick_stopped((predicted_index >= 0) && (touch_x_offset == predicted_index));
+            predicted_index = -1;
+            touch_y_offset  = 0.0;
+            flick_timestamp = 0;
+            start_touch     = {};
+            host.relayout();
+        }
+    }
+
+  private:
+    /* If in a vertical swipe or end of flick, let the host action the pull */
+    void handle_window_swipe()
+    {
+        if ((swipe_direction == touchswitch_swipe_t::VERTICAL) &&
+            touchswitch_pulled(touch_y_offset, host.get_workarea_height()))
+        {
+            host.slot_pulled(touch_y_offset);
+        }
+    }
+
+    /* Handle relative motion input. Should consider velocity of flick as well as mouse/touchscreen */
+    void handle_relative_motion(touchswitch_point_t diff, double time)
+    {
+        if (touch_held)
+        {
+            /* Dragging, follow where the finger will be when this frame is shown */
+            auto prediction = predict_touch(time);
+            diff.x += prediction.x - applied_prediction.x;
+            diff.y += prediction.y - applied_prediction.y;
+            applied_prediction = prediction;
+        }
+
+        /* These actions should be animated mutually exclusively. Only show the axis with larger difference */
+        if (swipe_direction == touchswitch_swipe_t::VERTICAL)
+        {
+            /* Dragging up or down */
+            touch_y_offset += diff.y;
+            host.relayout();
+        } else if (swipe_direction == touchswitch_swipe_t::HORIZONTAL)
+        {
+            /* Dragging left or right */
+            touch_y_offset = 0;
+            double motion_x = host.get_input_layout().offset_for_motion(diff.x);
+            if (motion_x == 0.0)
+            {
+                /* This layout does not scroll */
+                return;
+            }
+
+            touch_x_offset -= motion_x;
+
+            /* Force back into bounds if needed, also reset velocity if out of bounds */
+            double last = (double)host.get_slot_count() - 1;
+            if (touch_x_offset < 0.0)
+            {
+                touch_x_offset = 0.0;
+                velocity = {};
+            } else if (touch_x_offset >= last)
+            {
+                touch_x_offset = last;
+                velocity = {};
+            }
+
+            host.relayout();
+        }
+    }
+
+    /* Display time of the frame being rendered now. Each flick step then
+     * advances by exactly the time between displayed frames, rather than by
+     * however long rendering happened to take */
+    double get_next_frame_time()
+    {
+        double now = host.get_current_time();
+        double interval = present_interval_ms;
+        if ((last_present_ms <= 0) || (interval <= 0) ||
+            (now - last_present_ms > 4 * interval) || (now < last_present_ms))
+        {
+            /* No recent presentation feedback, fall back to the wall clock */
+            return now;
+        }
+
+        /* The first vblank after the point the flick has reached */
+        double frames = std::floor((flick_timestamp - last_present_ms) / interval) + 1;
+        return last_present_ms + std::max(frames, 1.0) * interval;
+    }
+
+    /* How far the finger is expected to move between the last motion event
+     * at `time` and the presentation of the next frame, bounded by the
+     * touch_prediction_max option */
+    touchswitch_point_t predict_touch(double time)
+    {
+        auto config = host.get_input_config();
+        if (!config.touch_prediction)
+        {
+            return {};
+        }
+
+        double frame_ms = host.get_frame_ms();
+        double lead     = host.get_current_time() - time + frame_ms;
+        lead = std::clamp(lead, 0.0, 2 * frame_ms);
+
+        auto estimate = motion_samples.estimate(time, PREDICTION_WINDOW_MS);
+        touchswitch_point_t prediction = {estimate.x * lead, estimate.y * lead};
+        double length = std::hypot(prediction.x, prediction.y);
+        double max    = std::max(config.touch_prediction_max, 0.0);
+        if (length > max)
+        {
+            prediction = {prediction.x * max / length, prediction.y * max / length};
+        }
+
+        return prediction;
+    }
+
+    /* Compute where a flick released now will stop, so the host can start
+     * preparing the slot it lands on while the carousel is still moving */
+    void predict_flick_landing()
+    {
+        predicted_index = -1;
+        size_t count = host.get_slot_count();
+        if ((swipe_direction != touchswitch_swipe_t::HORIZONTAL) || (count == 0))
+        {
+            return;
+        }
+
+        double distance = touchswitch_flick_distance(velocity.x,
+            std::hypot(velocity.x, velocity.y), host.get_input_config().flick_motion,
+            VELOCITY_THRESHOLD);
+        double landing = touch_x_offset - host.get_input_layout().offset_for_motion(distance);
+        if (std::isnan(landing))
+        {
+            return;
+        }
+
+        predicted_index = (long)std::clamp(std::round(landing), 0.0, count - 1.0);
+        host.flick_predicted(predicted_index);
+    }
+};
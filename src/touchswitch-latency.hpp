@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Histogram of the most recent latency samples, in milliseconds. Old samples
+ * drop out as new ones arrive, so the distribution follows the current
+ * behaviour rather than everything since startup.
+ *
+ * Buckets are powers of two: bucket 0 holds samples up to 0.125 ms, bucket i
+ * those up to 0.125 * 2^i ms, and the last bucket everything slower.
+ */
+class touchswitch_latency_histogram_t
+{
+  public:
+    static constexpr size_t WINDOW  = 256;
+    static constexpr size_t BUCKETS = 16;
+    static constexpr double FIRST_BUCKET_MS = 0.125;
+
+  private:
+    std::array<double, WINDOW> samples;
+    std::array<uint32_t, BUCKETS> buckets = {};
+    size_t head  = 0;
+    size_t count = 0;
+    uint64_t total = 0;
+
+    static size_t bucket_for(double ms)
+    {
+        size_t i = 0;
+        double bound = FIRST_BUCKET_MS;
+        while ((i + 1 < BUCKETS) && (ms > bound))
+        {
+            bound *= 2.0;
+            i++;
+        }
+
+        return i;
+    }
+
+  public:
+    void add(double ms)
+    {
+        if (count == WINDOW)
+        {
+            buckets[bucket_for(samples[head])]--;
+        } else
+        {
+            count++;
+        }
+
+        samples[head] = ms;
+        buckets[bucket_for(ms)]++;
+        head = (head + 1) % WINDOW;
+        total++;
+    }
+
+    /* Samples currently in the window */
+    size_t size() const
+    {
+        return count;
+    }
+
+    /* Samples ever added */
+    uint64_t get_total() const
+    {
+        return total;
+    }
+
+    /* Upper bound in ms of bucket i, infinite for the last one */
+    static double bucket_bound(size_t i)
+    {
+        if (i + 1 >= BUCKETS)
+        {
+            return INFINITY;
+        }
+
+        return FIRST_BUCKET_MS * std::pow(2.0, i);
+    }
+
+    uint32_t bucket(size_t i) const
+    {
+        return buckets[i];
+    }
+
+    /* The most recent sample */
+    double last() const
+    {
+        return count ? samples[(head + WINDOW - 1) % WINDOW] : 0.0;
+    }
+
+    /* The p-th quantile (0 to 1) of the samples in the window */
+    double quantile(double p) const
+    {
+        if (!count)
+        {
+            return 0.0;
+        }
+
+        std::vector<double> sorted(samples.begin(), samples.begin() + count);
+        size_t i = std::min(count - 1, (size_t)std::floor(p * count));
+        std::nth_element(sorted.begin(), sorted.begin() + i, sorted.end());
+        return sorted[i];
+    }
+};
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* An axis-aligned box in output-local coordinates */
+struct touchswitch_box_t
+{
+    double x = 0.0;
+    double y = 0.0;
+    double width  = 0.0;
+    double height = 0.0;
+};
+
+/**
+ * Computes where each slot of the switcher goes. The plugin fits the views
+ * of a slot into the returned box and animates them there, so hit-testing,
+ * transformers and overlays are the same for every layout.
+ */
+class touchswitch_layout_t
+{
+  protected:
+    touchswitch_box_t workarea;
+    double window_scale = 0.7;
+    double spacing = 50.0;
+
+  public:
+    virtual ~touchswitch_layout_t() = default;
+
+    /* Update the inputs of the layout, called before every layout pass */
+    void configure(const touchswitch_box_t& wa, double scale, double space)
+    {
+        workarea     = wa;
+        window_scale = scale;
+        spacing = space;
+    }
+
+    /* Box of slot `index` out of `count`, with the current scroll offset */
+    virtual touchswitch_box_t get_slot_box(size_t index, size_t count,
+        double offset) const = 0;
+
+    /* Change in scroll offset for a horizontal drag of dx pixels */
+    virtual double offset_for_motion(double dx) const = 0;
+
+    /* How many slots a step up or down moves the selection by */
+    virtual size_t get_row_stride(size_t count) const = 0;
+};
+
+/* A single row of slots, centred on the selected one */
+class touchswitch_carousel_layout_t : public touchswitch_layout_t
+{
+  public:
+    double get_slot_width() const
+    {
+        return std::max(workarea.width * window_scale, 1.0);
+    }
+
+    double get_slot_height() const
+    {
+        return std::max(workarea.height * window_scale, 1.0);
+    }
+
+    touchswitch_box_t get_slot_box(size_t index, size_t count,
+        double offset) const override
+    {
+        touchswitch_box_t box;
+        box.width  = get_slot_width();
+        box.height = get_slot_height();
+        double index_position = (double)index - offset;
+        box.x = workarea.x + workarea.width / 2.0 - box.width / 2.0 +
+            (spacing + box.width) * index_position;
+        box.y = workarea.y + workarea.height / 2.0 - box.height / 2.0;
+        return box;
+    }
+
+    double offset_for_motion(double dx) const override
+    {
+        /* Account for index-width not screen or window width */
+        return dx / (spacing + get_slot_width());
+    }
+
+    size_t get_row_stride(size_t count) const override
+    {
+        return 0;
+    }
+};
+
+/* All slots at once, in a grid fitted to the workarea */
+class touchswitch_grid_layout_t : public touchswitch_layout_t
+{
+    /* Pick the column count which gives the largest slots */
+    size_t get_columns(size_t count) const
+    {
+        size_t best_columns = 1;
+        double best_size    = -1.0;
+        double aspect = workarea.height > 0 ? workarea.width / workarea.height : 1.0;
+        for (size_t columns = 1; columns <= std::max<size_t>(count, 1); columns++)
+        {
+            size_t rows = (count + columns - 1) / columns;
+            double cell_width  = (workarea.width - spacing * (columns + 1)) / columns;
+            double cell_height = (workarea.height - spacing * (rows + 1)) / std::max<size_t>(rows, 1);
+            /* Slots keep the aspect ratio of the workarea */
+            double size = std::min(cell_width, cell_height * aspect);
+            if (size > best_size)
+            {
+                best_size    = size;
+                best_columns = columns;
+            }
+        }
+
+        return best_columns;
+    }
+
+  public:
+    touchswitch_box_t get_slot_box(size_t index, size_t count,
+        double offset) const override
+    {
+        size_t columns = get_columns(count);
+        size_t rows    = std::max<size_t>((count + columns - 1) / columns, 1);
+
+        touchswitch_box_t box;
+        box.width  = std::max((workarea.width - spacing * (columns + 1)) / columns, 1.0);
+        box.height = std::max((workarea.height - spacing * (rows + 1)) / rows, 1.0);
+
+        size_t row = index / columns;
+        size_t col = index % columns;
+        /* Centre the last, possibly partial, row */
+        size_t in_row = (row == rows - 1) ? count - row * columns : columns;
+        double row_start = workarea.x + (workarea.width -
+            (in_row * box.width + (in_row - 1) * spacing)) / 2.0;
+
+        box.x = row_start + col * (box.width + spacing);
+        box.y = workarea.y + spacing + row * (box.height + spacing);
+        return box;
+    }
+
+    double offset_for_motion(double dx) const override
+    {
+        /* Every slot is already visible, dragging does not scroll */
+        return 0.0;
+    }
+
+    size_t get_row_stride(size_t count) const override
+    {
+        return get_columns(count);
+    }
+};
+
+/**
+ * Boxes of the slots on an output, sorted by their left edge so a point can
+ * be resolved to its slot with a binary search instead of a scene walk.
+ */
+class touchswitch_slot_index_t
+{
+    struct entry_t
+    {
+        touchswitch_box_t box;
+        size_t slot;
+    };
+
+    std::vector<entry_t> entries;
+    double max_width = 0.0;
+
+  public:
+    void clear()
+    {
+        entries.clear();
+        max_width = 0.0;
+    }
+
+    bool empty() const
+    {
+        return entries.empty();
+    }
+
+    /* Add a box for the given slot, a slot may have several boxes */
+    void add(const touchswitch_box_t& box, size_t slot)
+    {
+        entries.push_back({box, slot});
+        max_width = std::max(max_width, box.width);
+    }
+
+    /* Sort the boxes, must be called after adding and before find() */
+    void build()
+    {
+        std::sort(entries.begin(), entries.end(), [] (const entry_t& a, const entry_t& b)
+        {
+            return a.box.x < b.box.x;
+        });
+    }
+
+    /* The slot with a box containing the point, or -1 if there is none */
+    long find(double x, double y) const
+    {
+        /* Only boxes starting left of x, and no wider than the widest box away, can match */
+        auto it = std::upper_bound(entries.begin(), entries.end(), x,
+            [] (double px, const entry_t& e) { return px < e.box.x; });
+        while (it != entries.begin())
+        {
+            --it;
+            if (it->box.x + max_width < x)
+            {
+                break;
+            }
+
+            const auto& box = it->box;
+            if ((x < box.x + box.width) && (y >= box.y) && (y < box.y + box.height))
+            {
+                return (long)it->slot;
+            }
+        }
+
+        return -1;
+    }
+};
+
+/* Create the layout engine for a `touchswitch/layout` option value */
+inline std::unique_ptr<touchswitch_layout_t> touchswitch_create_layout(const std::string& name)
+{
+    if (name == "grid")
+    {
+        return std::make_unique<touchswitch_grid_layout_t>();
+    }
+
+    return std::make_unique<touchswitch_carousel_layout_t>();
+}
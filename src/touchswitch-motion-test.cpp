@@ -0,0 +1,276 @@
+/**
+ * Feeds presses, jittery and at low and high rates, through the switcher's
+ * input handling and checks whether each release is taken as a flick. The
+ * same presses go through the classifier the release velocity estimate
+ * replaced, which must get more of them wrong.
+ *
+ * Traces given on the command line are replayed the same way. A trace whose
+ * file name starts with "flick" must be taken as a flick on every release,
+ * any other trace on none.
+ *
+ * Usage: touchswitch-motion-test [trace-file...]
+ */
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "touchswitch-gesture.hpp"
+#include "touchswitch-input.hpp"
+#include "touchswitch-physics.hpp"
+#include "touchswitch-test-host.hpp"
+#include "touchswitch-trace.hpp"
+
+static_assert(touchswitch_motion_tracker_t::CAPACITY * touchswitch_motion_tracker_t::MIN_SPACING_MS >=
+    TOUCHSWITCH_FLICK_WINDOW_MS, "the motion samples must span the flick window");
+
+/* An input event, with a time finer than a trace record can hold */
+struct motion_event_t
+{
+    uint32_t kind;
+    double time;
+    double x;
+    double y;
+};
+
+/* Press to release, with the expected decision */
+struct motion_case_t
+{
+    std::string name;
+    std::vector<motion_event_t> events;
+    bool flick;
+    /* Real speed in px/ms the estimate should be within 25% of, 0 to skip */
+    double speed;
+};
+
+struct decision_t
+{
+    bool flick = false;
+    double speed = 0.0;
+};
+
+/* Release decision of the plugin, through touchswitch_input_t */
+static decision_t classify(const std::vector<motion_event_t>& events)
+{
+    touchswitch_test_host_t host;
+    touchswitch_input_t input(host);
+    input.touch_x_offset = 10.0;
+
+    decision_t decision;
+    for (auto& e : events)
+    {
+        host.now = e.time;
+        if (e.kind == TOUCHSWITCH_TRACE_MOTION)
+        {
+            input.motion(e.time, {e.x, e.y});
+            input.flush_motion();
+            continue;
+        }
+
+        input.button(e.kind == TOUCHSWITCH_TRACE_PRESS, e.time, {e.x, e.y});
+        if (e.kind == TOUCHSWITCH_TRACE_RELEASE)
+        {
+            decision.flick = !input.is_velocity_zero();
+            decision.speed = std::hypot(input.velocity.x, input.velocity.y);
+        }
+    }
+
+    return decision;
+}
+
+/**
+ * Release decision of the classifier the motion samples replaced: a flick
+ * starts when two consecutive events are more than 50 px apart, and is
+ * called off again when two are 20 px apart or less. The release velocity
+ * is the distance from where it started over the time since.
+ */
+static decision_t classify_baseline(const std::vector<motion_event_t>& events)
+{
+    const double flick_threshold_start = 50;
+    const double flick_threshold_end   = 20;
+
+    touchswitch_swipe_t swipe = touchswitch_swipe_t::UNDECIDED;
+    double start_x = 0, start_y = 0, last_x = 0, last_y = 0;
+    double start_flick_x = 0, start_flick_y = 0;
+    double flick_timestamp = 0;
+    decision_t decision;
+    for (auto& e : events)
+    {
+        if (e.kind == TOUCHSWITCH_TRACE_PRESS)
+        {
+            swipe = touchswitch_swipe_t::UNDECIDED;
+            start_x = last_x = e.x;
+            start_y = last_y = e.y;
+            flick_timestamp = 0;
+        } else if (e.kind == TOUCHSWITCH_TRACE_MOTION)
+        {
+            if (!touchswitch_left_deadzone(e.x - start_x, e.y - start_y))
+            {
+                continue;
+            }
+
+            swipe = touchswitch_classify_swipe(swipe, e.x - start_x, e.y - start_y);
+            double distance = std::hypot(e.x - last_x, e.y - last_y);
+            if ((distance > flick_threshold_start) && (flick_timestamp == 0))
+            {
+                flick_timestamp = e.time;
+                start_flick_x   = e.x;
+                start_flick_y   = e.y;
+            } else if (distance <= flick_threshold_end)
+            {
+                flick_timestamp = 0;
+            }
+
+            last_x = e.x;
+            last_y = e.y;
+        } else
+        {
+            decision = {};
+            if ((swipe == touchswitch_swipe_t::UNDECIDED) || (flick_timestamp == 0))
+            {
+                continue;
+            }
+
+            double duration = e.time - flick_timestamp;
+            decision.speed = std::hypot(e.x - start_flick_x, e.y - start_flick_y) / duration;
+            decision.flick = (decision.speed > TOUCHSWITCH_VELOCITY_THRESHOLD);
+        }
+    }
+
+    return decision;
+}
+
+/* Repeatable digitizer noise, in pixels, for sample i */
+static double jitter(size_t i, double amplitude)
+{
+    static const double pattern[] = {0.3, -1.0, 0.7, 0.1, -0.6, 1.0, -0.4, -0.1, 0.8, -0.8, 0.0};
+    return amplitude * pattern[i % (sizeof(pattern) / sizeof(pattern[0]))];
+}
+
+/* A drag sampled at rate_hz: moving at speed px/ms for move_ms, then held
+ * still for hold_ms, with jitter of up to amplitude px on every sample */
+static motion_case_t generate(const char *name, double rate_hz, double speed, double move_ms,
+    double hold_ms, double amplitude, bool flick, bool check_speed)
+{
+    motion_case_t c;
+    c.name  = name;
+    c.flick = flick;
+    c.speed = check_speed ? speed : 0.0;
+
+    double interval = 1000.0 / rate_hz;
+    double end = move_ms + hold_ms;
+    size_t i   = 0;
+    double time = 0;
+    for (; time <= end; time += interval, i++)
+    {
+        double x = 400 + speed * std::min(time, move_ms) + jitter(i, amplitude);
+        double y = 540 + jitter(i + 3, amplitude);
+        c.events.push_back({(i == 0) ? (uint32_t)TOUCHSWITCH_TRACE_PRESS :
+            (uint32_t)TOUCHSWITCH_TRACE_MOTION, time, x, y});
+    }
+
+    /* The release arrives with the last sample */
+    c.events.back().kind = TOUCHSWITCH_TRACE_RELEASE;
+    return c;
+}
+
+/* Every press of the traces in a file, expected to be flicks by its name */
+static bool load_traces(const char *path, std::vector<motion_case_t>& cases)
+{
+    std::vector<touchswitch_trace_t> traces;
+    if (!touchswitch_read_trace(path, traces))
+    {
+        return false;
+    }
+
+    const char *base = std::strrchr(path, '/');
+    base = base ? base + 1 : path;
+    bool flick = !std::strncmp(base, "flick", 5);
+    for (auto& trace : traces)
+    {
+        motion_case_t c;
+        for (auto& r : trace.events)
+        {
+            if (r.kind == TOUCHSWITCH_TRACE_PRESS)
+            {
+                c = {};
+                c.name  = base;
+                c.flick = flick;
+            }
+
+            c.events.push_back({r.kind, (double)r.time, r.x, r.y});
+            if (r.kind == TOUCHSWITCH_TRACE_RELEASE)
+            {
+                cases.push_back(c);
+            }
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<motion_case_t> cases = {
+        generate("60 Hz flick", 60, 2.0, 200, 0, 3, true, true),
+        generate("30 Hz jittery flick", 30, 2.0, 300, 0, 10, true, true),
+        generate("20 Hz slow flick", 20, 1.0, 400, 0, 4, true, true),
+        generate("1000 Hz jittery flick", 1000, 1.5, 150, 0, 6, true, true),
+        generate("8000 Hz flick", 8000, 1.2, 150, 0, 2, true, true),
+        generate("60 Hz jittery slow drag", 60, 0.2, 500, 0, 12, false, false),
+        generate("1000 Hz jittery slow drag", 1000, 0.2, 500, 0, 12, false, false),
+        generate("60 Hz drag held before release", 60, 2.0, 300, 150, 3, false, false),
+        generate("1000 Hz drag held before release", 1000, 2.0, 300, 150, 3, false, false),
+        generate("30 Hz still press", 30, 0.0, 0, 400, 10, false, false),
+    };
+
+    int failures = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!load_traces(argv[i], cases))
+        {
+            std::printf("FAIL %s: not a valid touchswitch trace\n", argv[i]);
+            failures++;
+        }
+    }
+
+    size_t baseline_misfires = 0;
+    for (auto& c : cases)
+    {
+        auto decision = classify(c.events);
+        if (decision.flick != c.flick)
+        {
+            std::printf("FAIL %s: estimated %.3f px/ms, %s\n", c.name.c_str(), decision.speed,
+                decision.flick ? "taken as a flick" : "not taken as a flick");
+            failures++;
+        } else if ((c.speed > 0) && (std::abs(decision.speed - c.speed) > 0.25 * c.speed))
+        {
+            std::printf("FAIL %s: estimated %.3f px/ms, moving at %.3f px/ms\n",
+                c.name.c_str(), decision.speed, c.speed);
+            failures++;
+        }
+
+        if (classify_baseline(c.events).flick != c.flick)
+        {
+            std::printf("     %s: misfires with the two-event thresholds\n", c.name.c_str());
+            baseline_misfires++;
+        }
+    }
+
+    if (baseline_misfires <= (size_t)failures)
+    {
+        std::printf("FAIL the two-event thresholds misfired on %zu releases, the estimate "
+                    "on %d\n", baseline_misfires, failures);
+        failures++;
+    }
+
+    if (failures)
+    {
+        return 1;
+    }
+
+    std::printf("all %zu releases were classified correctly, the two-event thresholds "
+                "misfired on %zu\n", cases.size(), baseline_misfires);
+    return 0;
+}
@@ -0,0 +1,170 @@
+/**
+ * Checks that a flick lands on the same slot whatever the refresh rate, by
+ * driving the switcher's input handling through a drag, a release and the
+ * frames after it, and comparing against the landing predicted at release.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "touchswitch-gesture.hpp"
+#include "touchswitch-input.hpp"
+#include "touchswitch-physics.hpp"
+#include "touchswitch-test-host.hpp"
+
+static constexpr size_t SLOTS = 21;
+static constexpr double START_OFFSET = 10.0;
+/* The release happens between two frames */
+static constexpr double RELEASE_MS = 1000.3;
+/* Length of the drag before the release, and its motion event interval */
+static constexpr double DRAG_MS   = 150.0;
+static constexpr double MOTION_MS = 8.0;
+/* Give up on a flick which has not stopped after this long */
+static constexpr double LIMIT_MS = 60000.0;
+
+struct flick_result_t
+{
+    /* Slot predicted at release, -1 if none */
+    long predicted = -1;
+    /* Slot the flick independently should land on, from its release state */
+    long expected  = -1;
+    double offset  = 0.0;
+    bool stopped   = false;
+};
+
+/**
+ * Drag at velocity px/ms and release, with a frame presented every frame_ms
+ * and every drop_every-th vblank missed (0 for none), then render frames
+ * until the flick comes to rest.
+ */
+static flick_result_t run_flick(double velocity, double friction, double frame_ms,
+    size_t drop_every)
+{
+    touchswitch_test_host_t host;
+    host.frame_ms = frame_ms;
+    host.friction = friction;
+    host.slots    = SLOTS;
+    touchswitch_input_t input(host);
+    input.touch_x_offset = START_OFFSET;
+
+    flick_result_t result;
+    double press_ms = RELEASE_MS - DRAG_MS;
+    double next_motion = press_ms + MOTION_MS;
+    double vblank = std::floor(press_ms / frame_ms) * frame_ms + frame_ms;
+    const auto& position = [&] (double time)
+    {
+        return touchswitch_point_t{960 + velocity * (time - press_ms), 540};
+    };
+
+    host.now = press_ms;
+    input.button(true, press_ms, position(press_ms));
+    bool released = false;
+    for (size_t n = 1; !released || input.is_tracking(); n++, vblank += frame_ms)
+    {
+        /* Rendered half a frame before the vblank, as by the render hooks */
+        double render_ms = vblank - frame_ms / 2;
+        if (render_ms - RELEASE_MS > LIMIT_MS)
+        {
+            return result;
+        }
+
+        /* Input arriving before this frame is rendered */
+        for (; !released && (next_motion < std::min(render_ms, RELEASE_MS));
+             next_motion += MOTION_MS)
+        {
+            host.now = next_motion;
+            input.motion(next_motion, position(next_motion));
+        }
+
+        if (!released && (RELEASE_MS <= render_ms))
+        {
+            host.now = RELEASE_MS;
+            input.button(false, RELEASE_MS, position(RELEASE_MS));
+            released = true;
+            result.predicted = input.predicted_index;
+            double distance = touchswitch_flick_distance(input.velocity.x,
+                std::abs(input.velocity.x), friction, TOUCHSWITCH_VELOCITY_THRESHOLD);
+            double landing = input.touch_x_offset -
+                host.get_input_layout().offset_for_motion(distance);
+            result.expected = std::lround(std::clamp(landing, 0.0, SLOTS - 1.0));
+        }
+
+        if (drop_every && (n % drop_every == 0))
+        {
+            continue;
+        }
+
+        host.now = render_ms;
+        input.flush_motion();
+        input.step_flick();
+        input.presented(vblank, frame_ms);
+    }
+
+    result.offset  = input.touch_x_offset;
+    result.stopped = true;
+    return result;
+}
+
+int main()
+{
+    struct rate_t
+    {
+        const char *name;
+        double hz;
+        size_t drop_every;
+    };
+    const std::vector<rate_t> rates = {
+        {"30 Hz", 30, 0},
+        {"60 Hz", 60, 0},
+        {"120 Hz", 120, 0},
+        {"144 Hz", 144, 0},
+        {"60 Hz, every third frame dropped", 60, 3},
+    };
+
+    int failures = 0;
+    for (double friction : {0.0, 0.9, 0.95, 0.98, 1.0, 1.05})
+    {
+        for (double velocity : {0.6, -1.5, 2.0, 4.5, -9.0})
+        {
+            long reference = -1;
+            for (auto& rate : rates)
+            {
+                auto result = run_flick(velocity, friction, 1000.0 / rate.hz, rate.drop_every);
+                long landed = std::lround(result.offset);
+                if (!result.stopped)
+                {
+                    std::printf("FAIL friction %.2f, %.1f px/ms at %s: still moving\n",
+                        friction, velocity, rate.name);
+                    failures++;
+                } else if ((landed != result.expected) || (landed != result.predicted))
+                {
+                    std::printf("FAIL friction %.2f, %.1f px/ms at %s: landed on slot %ld "
+                                "(offset %.4f), expected slot %ld, predicted slot %ld\n",
+                        friction, velocity, rate.name, landed, result.offset,
+                        result.expected, result.predicted);
+                    failures++;
+                } else if ((reference >= 0) && (landed != reference))
+                {
+                    std::printf("FAIL friction %.2f, %.1f px/ms at %s: landed on slot %ld, "
+                                "slot %ld at %s\n", friction, velocity, rate.name, landed,
+                        reference, rates.front().name);
+                    failures++;
+                }
+
+                if (reference < 0)
+                {
+                    reference = landed;
+                }
+            }
+        }
+    }
+
+    if (failures)
+    {
+        return 1;
+    }
+
+    std::printf("all flicks landed on their predicted slot\n");
+    return 0;
+}
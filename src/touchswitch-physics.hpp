@@ -0,0 +1,256 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+/**
+ * Flick friction is configured by touchswitch/flick_motion as the factor the
+ * velocity keeps over one frame at this reference frame length. Internally it
+ * is a continuous exponential decay, so the same flick behaves identically at
+ * any refresh rate and across dropped frames.
+ */
+static constexpr double TOUCHSWITCH_FRICTION_REFERENCE_MS = 1000.0 / 60.0;
+
+/* Decay rate of the velocity per millisecond, infinite for friction 0 and
+ * zero or negative when the motion never stops */
+inline double touchswitch_friction_rate(double friction)
+{
+    if (friction <= 0.0)
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+
+    return -std::log(friction) / TOUCHSWITCH_FRICTION_REFERENCE_MS;
+}
+
+/* Result of advancing a flick by some amount of time */
+struct touchswitch_flick_step_t
+{
+    /* Factor the velocity is multiplied by */
+    double decay;
+    /* Factor the velocity is multiplied by to get the distance travelled */
+    double distance;
+};
+
+/* Advance a flick by dt_ms, integrating the decaying velocity exactly */
+inline touchswitch_flick_step_t touchswitch_flick_step(double friction, double dt_ms)
+{
+    double rate = touchswitch_friction_rate(friction);
+    if (std::isinf(rate))
+    {
+        return {0.0, 0.0};
+    }
+
+    if (rate == 0.0)
+    {
+        return {1.0, dt_ms};
+    }
+
+    double decay = std::exp(-rate * dt_ms);
+    return {decay, (1.0 - decay) / rate};
+}
+
+/* Distance still to be travelled by a flick moving at velocity, if it were
+ * left to coast to a complete stop */
+inline double touchswitch_flick_tail(double velocity, double friction)
+{
+    double rate = touchswitch_friction_rate(friction);
+    if (std::isinf(rate))
+    {
+        return 0.0;
+    }
+
+    if (rate <= 0.0)
+    {
+        /* Never stops unless grabbed */
+        return std::copysign(std::numeric_limits<double>::infinity(), velocity);
+    }
+
+    return velocity / rate;
+}
+
+/**
+ * Distance, in pixels, a flick released with the given velocity travels
+ * before it comes to a stop.
+ *
+ * When the speed drops below the threshold the flick is finished off with
+ * its remaining tail, so the total is exactly the integral of the decay and
+ * does not depend on the frame timing.
+ *
+ * @param velocity  Velocity along the axis of interest, in px/ms
+ * @param speed     Magnitude of the full velocity vector, in px/ms
+ * @param friction  The touchswitch/flick_motion option
+ * @param threshold Speed at or below which a release is not a flick
+ */
+inline double touchswitch_flick_distance(double velocity, double speed,
+    double friction, double threshold)
+{
+    if (speed <= threshold)
+    {
+        return 0.0;
+    }
+
+    return touchswitch_flick_tail(velocity, friction);
+}
+
+/**
+ * A critically damped spring moving a value towards a target. The target can
+ * be changed at any time and the value keeps its current velocity, so
+ * successive layouts bend the motion instead of restarting it.
+ */
+struct touchswitch_spring_t
+{
+    double value    = 0.0;
+    double target   = 0.0;
+    double velocity = 0.0;
+
+    /* Jump straight to the given value and stop */
+    void warp(double to)
+    {
+        value    = to;
+        target   = to;
+        velocity = 0.0;
+    }
+
+    /* Advance by dt_ms with angular frequency omega (per ms), using the exact
+     * solution of the critically damped oscillator */
+    void step(double dt_ms, double omega)
+    {
+        double offset = value - target;
+        double c     = velocity + omega * offset;
+        double decay = std::exp(-omega * dt_ms);
+        value    = target + (offset + c * dt_ms) * decay;
+        velocity = (velocity - omega * c * dt_ms) * decay;
+    }
+
+    /* Whether the value is, and will stay, within tolerance of the target
+     * over the next frame_ms */
+    bool settled(double tolerance, double frame_ms) const
+    {
+        return (std::abs(value - target) < tolerance) &&
+               (std::abs(velocity) * frame_ms < tolerance);
+    }
+};
+
+/* Angular frequency of a spring which settles within about duration_ms */
+inline double touchswitch_spring_omega(double duration_ms)
+{
+    /* A critically damped spring is within 1% of its target after 6.6/omega */
+    return 6.6 / std::max(duration_ms, 1.0);
+}
+
+/* A velocity in px/ms */
+struct touchswitch_velocity_t
+{
+    double x = 0.0;
+    double y = 0.0;
+};
+
+/**
+ * Keeps the most recent timestamped motion samples of a touch or drag, and
+ * estimates the release velocity from all of them instead of from the last
+ * two events, so low-rate and jittery digitizers still give a stable result.
+ */
+class touchswitch_motion_tracker_t
+{
+    struct sample_t
+    {
+        double time;
+        double x;
+        double y;
+    };
+
+  public:
+    /* Samples closer together than this replace the newest one, so that
+     * high-rate devices still fill the buffer with a full flick window */
+    static constexpr double MIN_SPACING_MS = 4.0;
+    /* Enough for the flick window at the minimum spacing, with room to spare */
+    static constexpr size_t CAPACITY = 32;
+
+  private:
+    std::array<sample_t, CAPACITY> samples;
+    size_t head  = 0;
+    size_t count = 0;
+
+  public:
+    void clear()
+    {
+        head  = 0;
+        count = 0;
+    }
+
+    void add(double time, double x, double y)
+    {
+        if ((count >= 2) && (time - get(1).time < MIN_SPACING_MS))
+        {
+            /* Keep the latest position without crowding out older samples */
+            samples[(head + CAPACITY - 1) % CAPACITY] = {time, x, y};
+            return;
+        }
+
+        samples[head] = {time, x, y};
+        head  = (head + 1) % CAPACITY;
+        count = std::min(count + 1, CAPACITY);
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    /* The i-th most recent sample, 0 being the newest */
+    const sample_t& get(size_t i) const
+    {
+        return samples[(head + CAPACITY - 1 - i) % CAPACITY];
+    }
+
+    /**
+     * Least-squares fit of position over time, using the samples no older
+     * than window_ms before `now`. Returns zero if the finger had stopped,
+     * or if there are too few samples to tell.
+     */
+    touchswitch_velocity_t estimate(double now, double window_ms) const
+    {
+        double sum_t = 0, sum_x = 0, sum_y = 0;
+        size_t n = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            auto& s = get(i);
+            if (now - s.time > window_ms)
+            {
+                break;
+            }
+
+            sum_t += s.time;
+            sum_x += s.x;
+            sum_y += s.y;
+            n++;
+        }
+
+        if (n < 2)
+        {
+            return {};
+        }
+
+        double mean_t = sum_t / n, mean_x = sum_x / n, mean_y = sum_y / n;
+        double var_t  = 0, cov_x = 0, cov_y = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            auto& s  = get(i);
+            double t = s.time - mean_t;
+            var_t += t * t;
+            cov_x += t * (s.x - mean_x);
+            cov_y += t * (s.y - mean_y);
+        }
+
+        if (var_t <= 0.0)
+        {
+            return {};
+        }
+
+        return {cov_x / var_t, cov_y / var_t};
+    }
+};
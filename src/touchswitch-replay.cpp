@@ -0,0 +1,442 @@
+/**
+ * Replays input traces recorded with touchswitch/trace_file through the
+ * switcher's input handling (touchswitch-input.hpp) and layout code, with a
+ * simulated output and frame clock, so gesture decisions and layout cost can
+ * be compared between builds.
+ *
+ * Usage: touchswitch-replay [-r refresh_hz] [-v] trace-file
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "touchswitch-input.hpp"
+#include "touchswitch-layout.hpp"
+#include "touchswitch-physics.hpp"
+#include "touchswitch-trace.hpp"
+
+/* Give up on a flick which is still moving this long after the last event */
+static constexpr double REPLAY_SETTLE_LIMIT_MS = 10000.0;
+
+static const char *kind_name(uint32_t kind)
+{
+    switch (kind)
+    {
+      case TOUCHSWITCH_TRACE_PRESS:
+        return "press";
+
+      case TOUCHSWITCH_TRACE_RELEASE:
+        return "release";
+
+      case TOUCHSWITCH_TRACE_MOTION:
+        return "motion";
+
+      default:
+        return "frame";
+    }
+}
+
+/* Position of a slot on screen, animated like the plugin's view transforms */
+struct touchswitch_replay_slot_t
+{
+    touchswitch_spring_t x, y, width, height;
+
+    void warp(const touchswitch_box_t& box)
+    {
+        x.warp(box.x);
+        y.warp(box.y);
+        width.warp(box.width);
+        height.warp(box.height);
+    }
+
+    void retarget(const touchswitch_box_t& box)
+    {
+        x.target = box.x;
+        y.target = box.y;
+        width.target  = box.width;
+        height.target = box.height;
+    }
+
+    void step(double dt_ms, double omega)
+    {
+        x.step(dt_ms, omega);
+        y.step(dt_ms, omega);
+        width.step(dt_ms, omega);
+        height.step(dt_ms, omega);
+    }
+
+    touchswitch_box_t box() const
+    {
+        return {x.value, y.value, width.value, height.value};
+    }
+};
+
+/* One session of the switcher, driven through the plugin's input handling
+ * with a simulated output and frame clock */
+class touchswitch_replay_t : public touchswitch_input_host_t
+{
+    touchswitch_trace_session_t session;
+    std::unique_ptr<touchswitch_layout_t> layout;
+    touchswitch_slot_index_t slot_index;
+    std::vector<touchswitch_replay_slot_t> slots;
+    bool verbose;
+    double frame_ms;
+    /* Simulated time of the event or frame being handled */
+    double now = 0;
+    long selected = -1;
+
+    /* Time spent in layout passes caused by the current event or frame */
+    double event_layout_us = 0;
+    size_t event_layouts   = 0;
+
+  public:
+    touchswitch_input_t input{*this};
+    bool done = false;
+    long final_slot = -1;
+    size_t flicks   = 0;
+    std::vector<double> layout_us;
+
+    touchswitch_replay_t(const touchswitch_trace_session_t& s, double frame_ms, bool verbose) :
+        session(s), verbose(verbose), frame_ms(frame_ms)
+    {
+        layout = touchswitch_create_layout(session.layout);
+        layout->configure({session.workarea_x, session.workarea_y,
+            session.workarea_width, session.workarea_height},
+            session.window_scale, session.spacing);
+        slots.resize(slot_count());
+        input.touch_x_offset = session.offset;
+        for (size_t j = 0; j < slot_count(); j++)
+        {
+            slots[j].warp(layout->get_slot_box(j, slot_count(), input.touch_x_offset));
+        }
+
+        build_slot_index();
+    }
+
+    size_t slot_count() const
+    {
+        return std::max<uint32_t>(session.slots, 1);
+    }
+
+    double get_current_time() override
+    {
+        return now;
+    }
+
+    double get_frame_ms() override
+    {
+        return frame_ms;
+    }
+
+    touchswitch_input_config_t get_input_config() override
+    {
+        touchswitch_input_config_t config;
+        config.flick_motion     = session.flick_motion;
+        config.touch_prediction = session.touch_prediction;
+        config.touch_prediction_max = session.touch_prediction_max;
+        return config;
+    }
+
+    size_t get_slot_count() override
+    {
+        return slot_count();
+    }
+
+    const touchswitch_layout_t& get_input_layout() override
+    {
+        return *layout;
+    }
+
+    double get_workarea_height() override
+    {
+        return session.workarea_height;
+    }
+
+    void select_slot_at(touchswitch_point_t at) override
+    {
+        selected = slot_index.find(at.x, at.y);
+        report(now, "press", selected);
+    }
+
+    /* Compute the target box of every slot, timing it. While the slots
+     * follow the input they jump there, as in setup_view_transform() */
+    void relayout() override
+    {
+        auto start = std::chrono::steady_clock::now();
+        bool tracking = input.is_tracking();
+        for (size_t j = 0; j < slot_count(); j++)
+        {
+            auto box = layout->get_slot_box(j, slot_count(), input.touch_x_offset);
+            if ((long)j == selected)
+            {
+                box.y += input.touch_y_offset;
+            }
+
+            if (tracking || (session.duration_ms <= 0))
+            {
+                slots[j].warp(box);
+            } else
+            {
+                slots[j].retarget(box);
+            }
+        }
+
+        std::chrono::duration<double, std::micro> took =
+            std::chrono::steady_clock::now() - start;
+        layout_us.push_back(took.count());
+        event_layout_us += took.count();
+        event_layouts++;
+    }
+
+    void slot_pulled(double dy) override
+    {
+        report(now, (dy < 0) ? "pull up" : "pull down", selected);
+    }
+
+    void tapped() override
+    {
+        if (selected >= 0)
+        {
+            report(now, "tap", selected);
+            final_slot = selected;
+            done = true;
+        } else
+        {
+            report(now, "tap background", -1);
+        }
+    }
+
+    void flick_stopped(bool as_predicted) override
+    {
+        report(now, "flick stopped", current_slot());
+        if (!as_predicted && (input.predicted_index >= 0))
+        {
+            std::printf("  %9s  %-18s slot %ld\n", "", "predicted", input.predicted_index);
+        }
+    }
+
+    /* Hit-test boxes are where the slots are shown, not where they head */
+    void build_slot_index()
+    {
+        slot_index.clear();
+        for (size_t j = 0; j < slot_count(); j++)
+        {
+            slot_index.add(slots[j].box(), j);
+        }
+
+        slot_index.build();
+    }
+
+    void report(double time, const char *what, long slot)
+    {
+        std::printf("  %9.1f  %-18s slot %ld\n", time, what, slot);
+    }
+
+    long current_slot() const
+    {
+        return std::lround(std::clamp(input.touch_x_offset, 0.0, (double)slot_count() - 1));
+    }
+
+    void report_swipe(touchswitch_swipe_t before)
+    {
+        if ((before != input.swipe_direction) &&
+            (input.swipe_direction != touchswitch_swipe_t::UNDECIDED))
+        {
+            report(now, (input.swipe_direction == touchswitch_swipe_t::VERTICAL) ?
+                "swipe vertical" : "swipe horizontal", selected);
+        }
+    }
+
+    void handle_event(const touchswitch_trace_record_t& e)
+    {
+        now = e.time;
+        if (e.kind == TOUCHSWITCH_TRACE_MOTION)
+        {
+            input.motion(e.time, {e.x, e.y});
+            return;
+        }
+
+        auto before = input.swipe_direction;
+        bool pressed = (e.kind == TOUCHSWITCH_TRACE_PRESS);
+        input.button(pressed, e.time, {e.x, e.y});
+        report_swipe(before);
+        if (pressed || (input.swipe_direction == touchswitch_swipe_t::UNDECIDED))
+        {
+            return;
+        }
+
+        if (input.is_velocity_zero())
+        {
+            report(e.time, "release drag", current_slot());
+            return;
+        }
+
+        flicks++;
+        std::printf("  %9.1f  %-18s slot %ld, %.2f px/ms towards slot %ld\n",
+            (double)e.time, "release flick", current_slot(),
+            std::hypot(input.velocity.x, input.velocity.y), input.predicted_index);
+    }
+
+    /* A frame rendered half a frame before its vblank, then presented */
+    void handle_frame(double vblank)
+    {
+        now = vblank - frame_ms / 2;
+        auto before = input.swipe_direction;
+        input.flush_motion();
+        report_swipe(before);
+
+        /* Move the slots to where this frame shows them */
+        double omega = touchswitch_spring_omega(session.duration_ms);
+        for (auto& slot : slots)
+        {
+            slot.step(frame_ms, omega);
+        }
+
+        build_slot_index();
+        input.step_flick();
+        input.presented(vblank, frame_ms);
+    }
+
+    bool settled()
+    {
+        return input.touch_held || input.is_velocity_zero();
+    }
+
+    /* Print and reset the layout work done for one event or frame */
+    void end_event(const char *what, double time)
+    {
+        if (verbose && event_layouts)
+        {
+            std::printf("  %9.1f  %-18s %zu layouts, %.1f us\n",
+                time, what, event_layouts, event_layout_us);
+        }
+
+        event_layouts   = 0;
+        event_layout_us = 0;
+    }
+
+    void finish()
+    {
+        if (final_slot < 0)
+        {
+            final_slot = current_slot();
+        }
+    }
+};
+
+static double percentile(std::vector<double> values, double p)
+{
+    if (values.empty())
+    {
+        return 0.0;
+    }
+
+    std::sort(values.begin(), values.end());
+    size_t i = std::min(values.size() - 1, (size_t)(p * values.size()));
+    return values[i];
+}
+
+static void replay_session(const touchswitch_trace_t& trace, size_t number,
+    double refresh_hz, bool verbose)
+{
+    auto& s = trace.session;
+    double hz = (refresh_hz > 0) ? refresh_hz : s.refresh_hz;
+    double frame_ms = 1000.0 / std::max(hz, 1.0);
+    std::printf("session %zu: %u slots, %s, %.0fx%.0f, %.1f Hz, %zu events\n",
+        number, s.slots, s.layout, s.workarea_width, s.workarea_height, hz,
+        trace.events.size());
+
+    touchswitch_replay_t replay(s, frame_ms, verbose);
+    replay.end_event("activate", 0);
+    /* Frames are rendered half a frame before their vblank */
+    double next_vblank = trace.events.empty() ? 0 : trace.events.front().time + frame_ms;
+    for (auto& e : trace.events)
+    {
+        while (next_vblank - frame_ms / 2 <= e.time)
+        {
+            replay.handle_frame(next_vblank);
+            replay.end_event("frame", next_vblank);
+            next_vblank += frame_ms;
+        }
+
+        replay.handle_event(e);
+        replay.end_event(kind_name(e.kind), e.time);
+        if (replay.done)
+        {
+            break;
+        }
+    }
+
+    /* Let a flick in progress come to rest */
+    double limit = next_vblank + REPLAY_SETTLE_LIMIT_MS;
+    while (!replay.done && !replay.settled() && (next_vblank < limit))
+    {
+        replay.handle_frame(next_vblank);
+        replay.end_event("frame", next_vblank);
+        next_vblank += frame_ms;
+    }
+
+    replay.finish();
+    auto& us = replay.layout_us;
+    double total = 0;
+    for (double t : us)
+    {
+        total += t;
+    }
+
+    std::printf("  final slot %ld, %zu flicks\n", replay.final_slot, replay.flicks);
+    std::printf("  %zu layouts, mean %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n\n",
+        us.size(), us.empty() ? 0.0 : total / us.size(), percentile(us, 0.5),
+        percentile(us, 0.99), percentile(us, 1.0));
+}
+
+int main(int argc, char **argv)
+{
+    double refresh_hz = 0;
+    bool verbose = false;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!std::strcmp(argv[i], "-r") && (i + 1 < argc))
+        {
+            refresh_hz = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "-v"))
+        {
+            verbose = true;
+        } else if (!path && (argv[i][0] != '-'))
+        {
+            path = argv[i];
+        } else
+        {
+            path = nullptr;
+            break;
+        }
+    }
+
+    if (!path)
+    {
+        std::fprintf(stderr, "usage: %s [-r refresh_hz] [-v] trace-file\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<touchswitch_trace_t> traces;
+    bool valid = touchswitch_read_trace(path, traces);
+    for (size_t i = 0; i < traces.size(); i++)
+    {
+        replay_session(traces[i], i + 1, refresh_hz, verbose);
+    }
+
+    if (!valid)
+    {
+        std::fprintf(stderr, "%s: not a valid touchswitch trace\n", path);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,215 @@
+#include "touchswitch-snapshot.hpp"
+#include "wayfire/debug.hpp"
+#include "wayfire/geometry.hpp"
+#include "wayfire/output.hpp"
+#include "wayfire/region.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <wayfire/opengl.hpp>
+#include <wayfire/util/log.hpp>
+
+touchswitch_snapshot_t *touchswitch_capture_snapshot(wayfire_toplevel_view view, float scale)
+{
+    auto output = view->get_output();
+    auto root   = view->get_surface_root_node();
+    auto bbox   = root->get_bounding_box();
+    if (!output || (bbox.width <= 0) || (bbox.height <= 0) || (scale <= 0))
+    {
+        return nullptr;
+    }
+
+    auto snapshot = view->get_data<touchswitch_snapshot_t>();
+    if (!snapshot)
+    {
+        view->store_data(std::make_unique<touchswitch_snapshot_t>());
+        snapshot = view->get_data<touchswitch_snapshot_t>();
+    }
+
+    if (snapshot->buffer.allocate({bbox.width, bbox.height}, scale) ==
+        wf::buffer_reallocation_result_t::FAILURE)
+    {
+        LOGE("touchswitch: could not allocate a snapshot of ", bbox.width, "x", bbox.height);
+        view->erase_data<touchswitch_snapshot_t>();
+        return nullptr;
+    }
+
+    /* Render the surface tree on its own, so neither our transformer nor the
+     * view being minimized or disabled changes what is captured */
+    std::vector<wf::scene::render_instance_uptr> instances;
+    root->gen_render_instances(instances, [] (const wf::region_t&) {}, output);
+
+    wf::render_target_t target{snapshot->buffer};
+    target.geometry = bbox;
+    target.scale    = scale;
+
+    wf::render_pass_params_t params;
+    params.instances = &instances;
+    params.damage    = bbox;
+    params.reference_output = output;
+    params.target = target;
+    params.background_color = {0, 0, 0, 0};
+    params.flags = wf::RPASS_CLEAR_BACKGROUND;
+    wf::render_pass_t::run(params);
+
+    snapshot->geometry = bbox;
+    snapshot->scale    = scale;
+    return snapshot.get();
+}
+
+/* Draw the whole of one buffer into another of the same area at a different scale */
+static void touchswitch_resample(wf::auxilliary_buffer_t& from, wf::auxilliary_buffer_t& to,
+    const wf::geometry_t& geometry, float scale, wf::output_t *output)
+{
+    wf::render_target_t target{to};
+    target.geometry = geometry;
+    target.scale    = scale;
+
+    wf::render_pass_params_t params;
+    params.damage = geometry;
+    params.reference_output = output;
+    params.target = target;
+
+    wf::render_pass_t pass{params};
+    pass.clear(geometry, {0, 0, 0, 0});
+    pass.add_texture(wf::texture_t::from_aux(from), target, geometry, geometry);
+    pass.submit();
+}
+
+touchswitch_snapshot_t *touchswitch_capture_filtered_snapshot(wayfire_toplevel_view view, float scale)
+{
+    auto output = view->get_output();
+    if (!output || (scale <= 0))
+    {
+        return nullptr;
+    }
+
+    float level = output->handle->scale;
+    if (scale * 2 > level)
+    {
+        /* Sampling directly does not skip any pixels */
+        return touchswitch_capture_snapshot(view, scale);
+    }
+
+    auto snapshot = touchswitch_capture_snapshot(view, level);
+    if (!snapshot)
+    {
+        return nullptr;
+    }
+
+    /* Each halving averages 2x2 pixels with the linear filter, the last step
+     * to the requested scale is less than a halving */
+    wf::auxilliary_buffer_t scratch;
+    auto *from = &snapshot->buffer;
+    auto *to   = &scratch;
+    auto size  = wf::dimensions(snapshot->geometry);
+    while (level > scale)
+    {
+        float next = std::max(level / 2, scale);
+        if (to->allocate(size, next) == wf::buffer_reallocation_result_t::FAILURE)
+        {
+            LOGE("touchswitch: could not allocate a filtered snapshot level");
+            view->erase_data<touchswitch_snapshot_t>();
+            return nullptr;
+        }
+
+        touchswitch_resample(*from, *to, snapshot->geometry, next, output);
+        std::swap(from, to);
+        level = next;
+    }
+
+    /* The last level may have landed in the scratch buffer */
+    if (from != &snapshot->buffer)
+    {
+        if (snapshot->buffer.allocate(size, level) == wf::buffer_reallocation_result_t::FAILURE)
+        {
+            view->erase_data<touchswitch_snapshot_t>();
+            return nullptr;
+        }
+
+        touchswitch_resample(scratch, snapshot->buffer, snapshot->geometry, level, output);
+    }
+
+    snapshot->scale = level;
+    return snapshot;
+}
+
+namespace wf
+{
+namespace scene
+{
+class touchswitch_snapshot_render_instance_t : public render_instance_t
+{
+    wf::signal::connection_t<node_damage_signal> on_node_damaged =
+        [=] (node_damage_signal *ev)
+    {
+        push_to_parent(ev->region);
+    };
+
+    std::shared_ptr<touchswitch_snapshot_node_t> self;
+    damage_callback push_to_parent;
+
+  public:
+    touchswitch_snapshot_render_instance_t(touchswitch_snapshot_node_t *self,
+        damage_callback push_dmg)
+    {
+        this->self = std::dynamic_pointer_cast<touchswitch_snapshot_node_t>(self->shared_from_this());
+        this->push_to_parent = push_dmg;
+        self->connect(&on_node_damaged);
+    }
+
+    void schedule_instructions(std::vector<render_instruction_t>& instructions,
+        const wf::render_target_t& target, wf::region_t& damage) override
+    {
+        if (!self->view->has_data<touchswitch_snapshot_t>())
+        {
+            return;
+        }
+
+        /* The node does not have children */
+        instructions.push_back(render_instruction_t{
+                    .instance = this,
+                    .target   = target,
+                    .damage   = damage & self->get_bounding_box(),
+                });
+    }
+
+    void render(const wf::scene::render_instruction_t& data) override
+    {
+        auto snapshot = self->view->get_data<touchswitch_snapshot_t>();
+        data.pass->add_texture(wf::texture_t::from_aux(snapshot->buffer), data.target,
+            snapshot->geometry, data.damage);
+    }
+};
+
+touchswitch_snapshot_node_t::touchswitch_snapshot_node_t(wayfire_toplevel_view view_) :
+    node_t(false), view(view_)
+{
+    last_geometry = get_bounding_box();
+}
+
+void touchswitch_snapshot_node_t::gen_render_instances(
+    std::vector<render_instance_uptr>& instances,
+    damage_callback push_damage, wf::output_t *output)
+{
+    instances.push_back(std::make_unique<touchswitch_snapshot_render_instance_t>(
+        this, push_damage));
+}
+
+wf::geometry_t touchswitch_snapshot_node_t::get_bounding_box()
+{
+    auto snapshot = view->get_data<touchswitch_snapshot_t>();
+    return snapshot ? snapshot->geometry : wf::geometry_t{0, 0, 0, 0};
+}
+
+void touchswitch_snapshot_node_t::damage()
+{
+    node_damage_signal ev;
+    ev.region = last_geometry;
+    last_geometry = get_bounding_box();
+    ev.region |= last_geometry;
+    this->emit(&ev);
+}
+}
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <wayfire/object.hpp>
+#include <wayfire/render.hpp>
+#include <wayfire/scene.hpp>
+#include <wayfire/scene-render.hpp>
+#include <wayfire/toplevel-view.hpp>
+
+/**
+ * A picture of a view's surfaces, stored with the view so that it is freed
+ * with it. Used to show a view in its slot without it being drawn live.
+ */
+struct touchswitch_snapshot_t : public wf::custom_data_t
+{
+    wf::auxilliary_buffer_t buffer;
+    /* Area of the surface tree the picture covers, in view coordinates */
+    wf::geometry_t geometry = {0, 0, 0, 0};
+    /* Buffer pixels per logical pixel */
+    float scale = 1.0;
+};
+
+/**
+ * Render the surfaces of a view, without any of its transformers, into its
+ * snapshot at the given scale. Works for minimized views too, as long as the
+ * client still has a buffer attached.
+ *
+ * @return The snapshot, or null if the view has nothing to show.
+ */
+touchswitch_snapshot_t *touchswitch_capture_snapshot(wayfire_toplevel_view view, float scale);
+
+/**
+ * Like touchswitch_capture_snapshot(), but for scales well below the
+ * output's: the surfaces are rendered at full resolution and halved
+ * repeatedly down to the given scale, like the levels of a mipmap, so that
+ * the result is filtered instead of aliased.
+ */
+touchswitch_snapshot_t *touchswitch_capture_filtered_snapshot(wayfire_toplevel_view view, float scale);
+
+namespace wf
+{
+namespace scene
+{
+/**
+ * Draws the snapshot of a view where its surfaces would be. It is added
+ * under the view's touchswitch transformer, so it is scaled, moved and
+ * decorated with overlays exactly like the live view it stands in for.
+ */
+class touchswitch_snapshot_node_t : public node_t
+{
+    /* Area damaged by the last redraw, the snapshot may since have moved */
+    wf::geometry_t last_geometry = {0, 0, 0, 0};
+
+  public:
+    wayfire_toplevel_view view;
+
+    touchswitch_snapshot_node_t(wayfire_toplevel_view view);
+
+    void gen_render_instances(std::vector<render_instance_uptr>& instances,
+        damage_callback push_damage, wf::output_t *output) override;
+
+    wf::geometry_t get_bounding_box() override;
+
+    std::string stringify() const override
+    {
+        return "touchswitch-snapshot";
+    }
+
+    /* Redraw after the snapshot was captured again */
+    void damage();
+};
+}
+}
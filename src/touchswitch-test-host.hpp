@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+
+#include "touchswitch-input.hpp"
+#include "touchswitch-layout.hpp"
+
+/**
+ * A switcher without an output for driving touchswitch_input_t in tests: a
+ * carousel on a 1920x1080 workarea, with the time set by the test.
+ */
+class touchswitch_test_host_t : public touchswitch_input_host_t
+{
+    touchswitch_carousel_layout_t layout;
+
+  public:
+    double now = 0;
+    double frame_ms = 1000.0 / 60.0;
+    double friction = 0.98;
+    size_t slots    = 21;
+    size_t taps     = 0;
+
+    touchswitch_test_host_t()
+    {
+        layout.configure({0, 0, 1920, 1080}, 0.7, 50);
+    }
+
+    double get_current_time() override
+    {
+        return now;
+    }
+
+    double get_frame_ms() override
+    {
+        return frame_ms;
+    }
+
+    touchswitch_input_config_t get_input_config() override
+    {
+        touchswitch_input_config_t config;
+        config.flick_motion = friction;
+        return config;
+    }
+
+    size_t get_slot_count() override
+    {
+        return slots;
+    }
+
+    const touchswitch_layout_t& get_input_layout() override
+    {
+        return layout;
+    }
+
+    double get_workarea_height() override
+    {
+        return 1080;
+    }
+
+    void select_slot_at(touchswitch_point_t) override
+    {}
+    void relayout() override
+    {}
+    void slot_pulled(double) override
+    {}
+
+    void tapped() override
+    {
+        taps++;
+    }
+};
@@ -92,6 +92,9 @@ class touchswitch_overlay_node_t : public node_t
      * Set in the pre-render hook and used in the render function. */
     bool overlay_shown = false;
     wf::wl_idle_call idle_update_title;
+    /* Result of the last dialog tree walk, valid for cached_generation */
+    bool cached_has_overlay = false;
+    uint64_t cached_generation = 0;
 
   private:
     /**
@@ -156,6 +159,11 @@ class touchswitch_overlay_node_t : public node_t
             return false;
         }
 
+        if (cached_generation == this->parent.tree_generation)
+        {
+            return cached_has_overlay;
+        }
+
         auto parent = find_topmost_parent(view);
 
         while (!parent->children.empty())
@@ -163,7 +171,9 @@ class touchswitch_overlay_node_t : public node_t
             parent = parent->children[0];
         }
 
-        return view == parent;
+        cached_generation  = this->parent.tree_generation;
+        cached_has_overlay = (view == parent);
+        return cached_has_overlay;
     }
 
     void update_title()
@@ -362,6 +372,7 @@ touchswitch_show_title_t::touchswitch_show_title_t() :
 
 add_title_overlay{[this] (touchswitch_transformer_added_signal *signal)
     {
+        tree_generation++;
         if (!show_view_title_overlay_opt)
         {
             /* TODO: support changing this option while scale is running! */
@@ -390,14 +401,27 @@ add_title_overlay{[this] (touchswitch_transformer_added_signal *signal)
         auto parent = std::dynamic_pointer_cast<wf::scene::floating_inner_node_t>(
             tr->parent()->shared_from_this());
 
-        auto node = std::make_shared<touchswitch_overlay_node_t>(signal->view, pos, *this);
+        /* Put back the node kept from the last activation, with its texture */
+        std::shared_ptr<touchswitch_overlay_node_t> node;
+        auto kept = standby_nodes.find(signal->view);
+        if (kept != standby_nodes.end())
+        {
+            node = kept->second;
+            standby_nodes.erase(kept);
+        } else
+        {
+            node = std::make_shared<touchswitch_overlay_node_t>(signal->view, pos, *this);
+        }
+
         wf::scene::add_front(parent, node);
         wf::scene::damage_node(parent, parent->get_bounding_box());
     }
 },
 
-rem_title_overlay{[] (touchswitch_transformer_removed_signal *signal)
+rem_title_overlay{[this] (touchswitch_transformer_removed_signal *signal)
     {
+        tree_generation++;
+        standby_nodes.erase(signal->view);
         using namespace wf::scene;
         node_t *tr = signal->view->get_transformed_node()->get_transformer(TOUCHSWITCH_TRANSFORMER).get();
 
@@ -412,6 +436,29 @@ rem_title_overlay{[] (touchswitch_transformer_removed_signal *signal)
                 }
             }
 
+            tr = tr->parent();
+        }
+    }
+},
+
+standby_title_overlay{[this] (touchswitch_transformer_standby_signal *signal)
+    {
+        tree_generation++;
+        using namespace wf::scene;
+        node_t *tr = signal->view->get_transformed_node()->get_transformer(TOUCHSWITCH_TRANSFORMER).get();
+
+        while (tr)
+        {
+            for (auto& ch : tr->get_children())
+            {
+                if (auto node = std::dynamic_pointer_cast<touchswitch_overlay_node_t>(ch))
+                {
+                    standby_nodes[signal->view] = node;
+                    remove_child(ch);
+                    break;
+                }
+            }
+
             tr = tr->parent();
         }
     }
@@ -423,6 +470,7 @@ void touchswitch_show_title_t::init(wf::output_t *output)
     this->output = output;
     output->connect(&add_title_overlay);
     output->connect(&rem_title_overlay);
+    output->connect(&standby_title_overlay);
     output->connect(&touchswitch_end);
     output->connect(&touchswitch_update);
 
@@ -2,6 +2,8 @@
 
 #include "wayfire/signal-definitions.hpp"
 #include "wayfire/signal-provider.hpp"
+#include <map>
+#include <memory>
 #include <string>
 
 #include <wayfire/plugin.hpp>
@@ -42,6 +44,7 @@ class touchswitch_show_title_t
     wf::signal::connection_t<touchswitch_update_signal> touchswitch_update;
     wf::signal::connection_t<touchswitch_transformer_added_signal> add_title_overlay;
     wf::signal::connection_t<touchswitch_transformer_removed_signal> rem_title_overlay;
+    wf::signal::connection_t<touchswitch_transformer_standby_signal> standby_title_overlay;
 
     enum class title_overlay_t
     {
@@ -56,4 +59,11 @@ class touchswitch_show_title_t
     wayfire_view last_title_overlay = nullptr;
 
     void update_title_overlay_opt();
+
+    /* Bumped whenever a transformer is added or removed, so overlay nodes
+     * know when the dialog trees they depend on may have changed */
+    uint64_t tree_generation = 0;
+
+    /* Overlay nodes taken out of the scene while their view is in standby */
+    std::map<wayfire_toplevel_view, std::shared_ptr<wf::scene::touchswitch_overlay_node_t>> standby_nodes;
 };
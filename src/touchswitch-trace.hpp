@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * Input traces recorded while the switcher is active, for replaying gestures
+ * offline with touchswitch-replay.
+ *
+ * A trace file is a sequence of sessions, one per activation. Each session is
+ * a TOUCHSWITCH_TRACE_SESSION record followed by a touchswitch_trace_session_t
+ * describing the output and options, then a record per input event. All
+ * values are in host byte order, traces are not meant to move between
+ * machines.
+ */
+static constexpr uint32_t TOUCHSWITCH_TRACE_MAGIC   = 0x52545354; /* "TSTR" */
+static constexpr uint32_t TOUCHSWITCH_TRACE_VERSION = 2;
+
+enum touchswitch_trace_kind_t : uint32_t
+{
+    TOUCHSWITCH_TRACE_SESSION = 0,
+    TOUCHSWITCH_TRACE_PRESS   = 1,
+    TOUCHSWITCH_TRACE_RELEASE = 2,
+    TOUCHSWITCH_TRACE_MOTION  = 3,
+};
+
+/* An input event, with its position in output-local coordinates */
+struct touchswitch_trace_record_t
+{
+    uint32_t kind;
+    uint32_t time;
+    float x;
+    float y;
+};
+
+/* State of the switcher when a session starts */
+struct touchswitch_trace_session_t
+{
+    uint32_t magic   = TOUCHSWITCH_TRACE_MAGIC;
+    uint32_t version = TOUCHSWITCH_TRACE_VERSION;
+    float workarea_x = 0, workarea_y = 0, workarea_width = 0, workarea_height = 0;
+    float refresh_hz = 60;
+    uint32_t slots   = 0;
+    float offset     = 0;
+    float window_scale = 0.7f;
+    float spacing = 50;
+    float flick_motion = 0.98f;
+    float duration_ms  = 300;
+    uint32_t touch_prediction = 0;
+    float touch_prediction_max = 40;
+    char layout[16] = {0};
+};
+
+/* Appends sessions to a trace file, buffered by stdio */
+class touchswitch_trace_writer_t
+{
+    FILE *file = nullptr;
+
+  public:
+    ~touchswitch_trace_writer_t()
+    {
+        close();
+    }
+
+    bool is_open() const
+    {
+        return file != nullptr;
+    }
+
+    bool open(const std::string& path)
+    {
+        close();
+        file = std::fopen(path.c_str(), "ab");
+        return file != nullptr;
+    }
+
+    void close()
+    {
+        if (file)
+        {
+            std::fclose(file);
+            file = nullptr;
+        }
+    }
+
+    void begin_session(const touchswitch_trace_session_t& session)
+    {
+        record(TOUCHSWITCH_TRACE_SESSION, 0, 0, 0);
+        if (file)
+        {
+            std::fwrite(&session, sizeof(session), 1, file);
+        }
+    }
+
+    void record(uint32_t kind, uint32_t time, double x, double y)
+    {
+        if (file)
+        {
+            touchswitch_trace_record_t r = {kind, time, (float)x, (float)y};
+            std::fwrite(&r, sizeof(r), 1, file);
+        }
+    }
+};
+
+/* A session read back from a trace file */
+struct touchswitch_trace_t
+{
+    touchswitch_trace_session_t session;
+    std::vector<touchswitch_trace_record_t> events;
+};
+
+/* Read every session of a trace file, returns false if it is not a valid trace */
+inline bool touchswitch_read_trace(const std::string& path, std::vector<touchswitch_trace_t>& out)
+{
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        return false;
+    }
+
+    bool valid = true;
+    touchswitch_trace_record_t r;
+    while (std::fread(&r, sizeof(r), 1, file) == 1)
+    {
+        if (r.kind == TOUCHSWITCH_TRACE_SESSION)
+        {
+            touchswitch_trace_t trace;
+            if ((std::fread(&trace.session, sizeof(trace.session), 1, file) != 1) ||
+                (trace.session.magic != TOUCHSWITCH_TRACE_MAGIC) ||
+                (trace.session.version != TOUCHSWITCH_TRACE_VERSION))
+            {
+                valid = false;
+                break;
+            }
+
+            trace.session.layout[sizeof(trace.session.layout) - 1] = '\0';
+            out.push_back(trace);
+        } else if (out.empty() || (r.kind > TOUCHSWITCH_TRACE_MOTION))
+        {
+            valid = false;
+            break;
+        } else
+        {
+            out.back().events.push_back(r);
+        }
+    }
+
+    std::fclose(file);
+    return valid;
+}
@@ -2,6 +2,12 @@
  * Original code by: Scott Moreau, Daniel Kondor
  */
 #include <map>
+#include <set>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <optional>
 #include <memory>
 #include <wayfire/workarea.hpp>
 #include <wayfire/seat.hpp>
@@ -17,17 +23,29 @@
 #include <wayfire/plugins/touchswitch-signal.hpp>
 #include <wayfire/plugins/wobbly/wobbly-signal.hpp>
 #include <wayfire/window-manager.hpp>
+#include <wayfire/util.hpp>
+#include <wayfire/nonstd/wlroots-full.hpp>
 
 #include <wayfire/plugins/common/move-drag-interface.hpp>
 #include <wayfire/plugins/common/shared-core-data.hpp>
 #include <wayfire/plugins/common/input-grab.hpp>
 
 #include <linux/input-event-codes.h>
+#include <xkbcommon/xkbcommon.h>
 
 #include "wayfire/plugins/ipc/ipc-activator.hpp"
+#include "wayfire/plugins/ipc/ipc-helpers.hpp"
+#include "wayfire/plugins/ipc/ipc-method-repository.hpp"
 #include "touchswitch.hpp"
 #include "touchswitch-title-overlay.hpp"
 #include "touchswitch-icon-overlay.hpp"
+#include "touchswitch-layout.hpp"
+#include "touchswitch-physics.hpp"
+#include "touchswitch-gesture.hpp"
+#include "touchswitch-input.hpp"
+#include "touchswitch-trace.hpp"
+#include "touchswitch-latency.hpp"
+#include "touchswitch-snapshot.hpp"
 #include "wayfire/core.hpp"
 #include "wayfire/debug.hpp"
 #include "wayfire/plugin.hpp"
@@ -39,31 +57,314 @@
 #include "wayfire/view.hpp"
 
 static constexpr const char *TOUCHSWITCH_TRANSFORMER = "touchswitch";
-using namespace wf::animation;
 
-class touchswitch_animation_t : public duration_t
+/**
+ * One animation timeline per output. It is advanced once per frame, reads
+ * the duration option once, and counts the running animations so nothing
+ * has to scan every slot to find out whether to keep rendering.
+ */
+class touchswitch_animation_clock_t
 {
+    wf::option_wrapper_t<wf::animation_description_t> duration{"touchswitch/duration"};
+
   public:
-    using duration_t::duration_t;
-    timed_transition_t scale_x{*this};
-    timed_transition_t scale_y{*this};
-    timed_transition_t translation_x{*this};
-    timed_transition_t translation_y{*this};
+    /* Time of the current frame */
+    uint32_t now = 0;
+    /* Spring frequency for this frame */
+    double omega = 0.0;
+    /* Length of a frame on the output, springs are settled once they would
+     * move less than a pixel over it */
+    double frame_ms = 1000.0 / 60.0;
+    /* Whether the duration is zero and animations should jump to their end */
+    bool instant = false;
+    size_t running = 0;
+
+    /* Advance the timeline, called once per frame before rendering */
+    void tick(double frame_length_ms)
+    {
+        now = wf::get_current_time();
+        frame_ms = frame_length_ms;
+        double length = get_length_ms();
+        instant = (length <= 0);
+        omega   = touchswitch_spring_omega(length);
+    }
+
+    /* Length of the animations in ms, from the duration option */
+    double get_length_ms()
+    {
+        return ((wf::animation_description_t)duration).length_ms;
+    }
+
+    /* Register the start of an animation, returning its start time */
+    uint32_t start()
+    {
+        running++;
+        return wf::get_current_time();
+    }
+
+    void end()
+    {
+        running--;
+    }
+
+    /* Time an animation last advanced at `last` moves forward this frame */
+    double get_step(uint32_t& last) const
+    {
+        uint32_t from = last;
+        last = std::max(last, now);
+        return (now > from) ? now - from : 0.0;
+    }
+
+    void reset()
+    {
+        running = 0;
+    }
 };
 
-struct wf_scale_animation_attribs
+/**
+ * Spring animation of the transform of one view. Retargeting keeps the
+ * current velocity, and the animation stops by itself once every component
+ * is within a pixel of its target.
+ */
+class touchswitch_animation_t
 {
-    wf::option_wrapper_t<wf::animation_description_t> duration{"touchswitch/duration"};
-    touchswitch_animation_t scale_animation{duration};
+    /* Time of the frame the springs were last advanced to */
+    uint32_t last_step = 0;
+    bool is_running    = false;
+
+  public:
+    touchswitch_spring_t scale_x;
+    touchswitch_spring_t scale_y;
+    touchswitch_spring_t translation_x;
+    touchswitch_spring_t translation_y;
+
+    /* Move towards a new target, starting from the transformer's current
+     * state unless already in motion */
+    void animate(touchswitch_animation_clock_t& clock,
+        const wf::scene::view_2d_transformer_t& from,
+        double to_scale_x, double to_scale_y,
+        double to_translation_x, double to_translation_y)
+    {
+        if (!is_running)
+        {
+            scale_x.warp(from.scale_x);
+            scale_y.warp(from.scale_y);
+            translation_x.warp(from.translation_x);
+            translation_y.warp(from.translation_y);
+            last_step  = clock.start();
+            is_running = true;
+        }
+
+        scale_x.target = to_scale_x;
+        scale_y.target = to_scale_y;
+        translation_x.target = to_translation_x;
+        translation_y.target = to_translation_y;
+    }
+
+    /* Stop at the given transform */
+    void warp(touchswitch_animation_clock_t& clock,
+        double to_scale_x, double to_scale_y,
+        double to_translation_x, double to_translation_y)
+    {
+        scale_x.warp(to_scale_x);
+        scale_y.warp(to_scale_y);
+        translation_x.warp(to_translation_x);
+        translation_y.warp(to_translation_y);
+        if (is_running)
+        {
+            clock.end();
+            is_running = false;
+        }
+    }
+
+    /* Advance the springs to the clock's current frame. `size` is the size
+     * of the view, used to express the scale tolerance in pixels */
+    void tick(touchswitch_animation_clock_t& clock, wf::dimensions_t size)
+    {
+        if (!is_running)
+        {
+            return;
+        }
+
+        if (clock.instant)
+        {
+            warp(clock, scale_x.target, scale_y.target,
+                translation_x.target, translation_y.target);
+            return;
+        }
+
+        double dt = clock.get_step(last_step);
+        for (auto spring : {&scale_x, &scale_y, &translation_x, &translation_y})
+        {
+            spring->step(dt, clock.omega);
+        }
+
+        const double frame_ms  = clock.frame_ms;
+        const double scale_tol = 1.0 / std::max({size.width, size.height, 1});
+        if (scale_x.settled(scale_tol, frame_ms) && scale_y.settled(scale_tol, frame_ms) &&
+            translation_x.settled(1.0, frame_ms) && translation_y.settled(1.0, frame_ms))
+        {
+            warp(clock, scale_x.target, scale_y.target,
+                translation_x.target, translation_y.target);
+        }
+    }
+
+    bool running() const
+    {
+        return is_running;
+    }
 };
 
 struct view_scale_data
 {
     std::shared_ptr<wf::scene::view_2d_transformer_t> transformer;
-    wf_scale_animation_attribs animation;
+    touchswitch_animation_t animation;
     bool was_minimized;
 };
 
+/* Layout inputs of a slot, kept between layouts and invalidated by view signals */
+struct slot_cache_t
+{
+    bool valid = false;
+    /* The dialog tree of the slot, as returned by enumerate_views(true) */
+    std::vector<wayfire_toplevel_view> tree;
+    std::vector<wf::geometry_t> geometries;
+    std::vector<double> scales;
+    /* Scale of the slot's main view, children are clamped against it */
+    double view_scale = 1.0;
+    /* The slot size and zoom setting the scales were computed for */
+    double scaled_width  = 0.0;
+    double scaled_height = 0.0;
+    bool allow_zoom = false;
+};
+
+struct touchswitch_stats_t
+{
+    uint64_t slot_cache_hits   = 0;
+    uint64_t slot_cache_misses = 0;
+    /* Damage pushed by batched transform updates, and the area the same
+     * updates would have damaged with one push per view */
+    uint64_t damage_batches = 0;
+    uint64_t damage_batched_area  = 0;
+    uint64_t damage_per_view_area = 0;
+    /* Flicks whose landing slot was predicted at release, and how many
+     * of those predictions turned out right */
+    uint64_t flick_predictions = 0;
+    uint64_t flick_predictions_hit = 0;
+    /* Frames which were not displayed on time while a flick was moving */
+    uint64_t flick_missed_frames = 0;
+    /* Pointer and touch motion events received, and layout passes run */
+    uint64_t motion_events = 0;
+    uint64_t layouts = 0;
+    /* Activation work deferred past the first frame, and the frames it took */
+    uint64_t staged_items  = 0;
+    uint64_t staged_frames = 0;
+    /* Views minimized when closing, and the time it took */
+    uint64_t minimized_views = 0;
+    uint64_t minimize_us     = 0;
+    /* Minimized views shown from their snapshot, and those which had to be
+     * unminimized because there was none */
+    uint64_t snapshot_slots = 0;
+    uint64_t unminimized_slots = 0;
+    /* Snapshots taken of live views for static thumbnails */
+    uint64_t thumbnail_captures = 0;
+    /* Snapshots of throttled slots refreshed, each allowing a client frame */
+    uint64_t throttled_refreshes = 0;
+    /* Filtered snapshots of small views taken, including refreshes */
+    uint64_t lod_captures = 0;
+};
+
+/**
+ * Lifecycle of an activation. Closing and teardown only go forwards: once
+ * the switcher is closing, signals about views only release what the
+ * switcher holds for them and never lay out again, and teardown ignores
+ * them entirely.
+ */
+enum class touchswitch_phase_t
+{
+    INACTIVE,
+    ACTIVE,
+    /* deactivate() ran, the exit animation is playing */
+    CLOSING,
+    /* finalize() is running */
+    TEARDOWN,
+};
+
+/* Rolling latency histograms of an output, kept across activations */
+struct touchswitch_latency_t
+{
+    /* From the activation request to the end of activate() */
+    touchswitch_latency_histogram_t activate;
+    /* From the activation request to the first frame being rendered */
+    touchswitch_latency_histogram_t first_frame;
+    /* From the activation request to that frame being shown */
+    touchswitch_latency_histogram_t first_present;
+    /* From deactivate() to finalize(), once the exit animation settled */
+    touchswitch_latency_histogram_t deactivate;
+};
+
+/**
+ * Applies the transform changes of many views and damages the union of
+ * their old and new bounding boxes once, instead of wrapping each view in
+ * begin_transform_update()/end_transform_update().
+ */
+class touchswitch_transform_batch_t
+{
+    wf::region_t damage;
+    uint64_t per_view_area = 0;
+    bool pending = false;
+
+    static uint64_t area(const wf::geometry_t& box)
+    {
+        return (uint64_t)std::max(box.width, 0) * std::max(box.height, 0);
+    }
+
+  public:
+    void set(wayfire_toplevel_view view,
+        const std::shared_ptr<wf::scene::view_2d_transformer_t>& transformer,
+        double scale_x, double scale_y, double translation_x, double translation_y)
+    {
+        auto node   = view->get_transformed_node();
+        auto before = node->get_bounding_box();
+        transformer->scale_x = scale_x;
+        transformer->scale_y = scale_y;
+        transformer->translation_x = translation_x;
+        transformer->translation_y = translation_y;
+        auto after = node->get_bounding_box();
+
+        damage |= before;
+        damage |= after;
+        per_view_area += area(before) + area(after);
+        pending = true;
+    }
+
+    /* Push the merged damage and a single scene geometry update */
+    void commit(wf::output_t *output, touchswitch_stats_t& stats)
+    {
+        if (!pending)
+        {
+            return;
+        }
+
+        uint64_t merged_area = 0;
+        for (const auto& box : damage)
+        {
+            merged_area += (uint64_t)(box.x2 - box.x1) * (box.y2 - box.y1);
+        }
+
+        output->render->damage(damage);
+        wf::scene::update(wf::get_core().scene(), wf::scene::update_flag::GEOMETRY);
+
+        stats.damage_batches++;
+        stats.damage_batched_area  += merged_area;
+        stats.damage_per_view_area += per_view_area;
+
+        damage.clear();
+        per_view_area = 0;
+        pending = false;
+    }
+};
+
 /**
  * Touchswitch is intended to be used by mouse or touch
  *
@@ -83,27 +384,98 @@ struct view_scale_data
 class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
     public wf::keyboard_interaction_t,
     public wf::pointer_interaction_t,
-    public wf::touch_interaction_t
+    public wf::touch_interaction_t,
+    public touchswitch_input_host_t
 {
-    enum class swipe_direction_option
-    {
-        UNDECIDED,
-        VERTICAL,
-        HORIZONTAL,
-    };
     /* helper class for optionally showing title overlays */
     touchswitch_show_title_t show_title;
     touchswitch_show_icon_t show_icon;
     bool hook_set;
-    bool touch_held;
-    uint32_t flick_timestamp = 0;
-    wf::pointf_t last_touch, start_touch, start_flick, velocity;
-    double touch_x_offset = std::numeric_limits<double>::quiet_NaN();
-    double touch_y_offset = 0.0;
+    wf::wl_listener_wrapper on_present;
+    /* Drags, flicks and the selection, shared with touchswitch-replay */
+    touchswitch_input_t input{*this};
     /* View over which the last input press happened */
     wayfire_toplevel_view last_selected_view;
     std::map<wayfire_toplevel_view, view_scale_data> scale_data;
-    swipe_direction_option swipe_direction=swipe_direction_option::UNDECIDED;
+    /* Per-slot cache, keyed by the topmost parent of each slot */
+    std::map<wayfire_toplevel_view, slot_cache_t> slot_cache;
+    /* Slots whose geometry changed since the last frame */
+    std::set<wayfire_toplevel_view> dirty_slots;
+    touchswitch_transform_batch_t transform_batch;
+    /* Type-to-filter state: the query, the lowercased title and app_id of
+     * each view for this activation, and the slots hidden by the query */
+    std::string filter_query;
+    std::map<wayfire_toplevel_view, std::string> search_index;
+    std::set<wayfire_toplevel_view> filtered_out;
+    /* Input trace of the current activation, see touchswitch/trace_file */
+    touchswitch_trace_writer_t trace;
+    /**
+     * Staged activation: the first frame only shows the slot transforms.
+     * Overlays of new transformers, minimized slots off-screen and the
+     * thumbnails of slots off-screen are done over the following frames,
+     * nearest to the selection first, within touchswitch/activation_budget
+     * per frame.
+     */
+    struct staged_item_t
+    {
+        enum kind_t
+        {
+            /* Announce the transformer of a view */
+            ANNOUNCE,
+            /* Lay out a deferred slot */
+            SLOT,
+            /* Capture the thumbnails of a slot */
+            CAPTURE,
+        };
+
+        wayfire_toplevel_view view;
+        kind_t kind;
+    };
+    bool staging = false;
+    bool staging_first_frame = false;
+    std::vector<staged_item_t> staged_work;
+    std::set<wayfire_toplevel_view> unannounced;
+    std::set<wayfire_toplevel_view> staged_slots;
+    /* Slots off-screen shown live, or blank if minimized, until captured */
+    std::set<wayfire_toplevel_view> staged_captures;
+    wayfire_toplevel_view forced_slot = nullptr;
+    /* Activation timing, see touchswitch_latency_t */
+    using latency_clock = std::chrono::steady_clock;
+    std::optional<latency_clock::time_point> activation_request;
+    latency_clock::time_point activation_start;
+    latency_clock::time_point first_frame_time;
+    latency_clock::time_point deactivation_start;
+    bool awaiting_first_frame   = false;
+    bool awaiting_first_present = false;
+    bool deactivating = false;
+    /* Transformers detached at the end of the last activation, kept with
+     * their overlays for the next one, see touchswitch/warm_standby */
+    std::map<wayfire_toplevel_view, std::shared_ptr<wf::scene::view_2d_transformer_t>> standby;
+    /* Views drawn in their slot from a snapshot instead of their surfaces */
+    struct snapshot_slot_t
+    {
+        std::shared_ptr<wf::scene::touchswitch_snapshot_node_t> node;
+        /* The view is minimized and its root node is enabled only for us */
+        bool holds_root = false;
+        /* A filtered snapshot standing in for a view shown very small */
+        bool lod = false;
+    };
+    std::map<wayfire_toplevel_view, snapshot_slot_t> snapshot_nodes;
+    /* The centre slot, drawn live when static thumbnails are shown or
+     * frames are throttled */
+    wayfire_toplevel_view live_view = nullptr;
+    /* Refreshes throttled slots on screen, see touchswitch/frame_throttle */
+    wf::wl_timer<true> throttle_timer;
+    /* Refreshes filtered snapshots on screen, see touchswitch/lod_scale */
+    wf::wl_timer<true> lod_timer;
+    /* Slot boxes as currently shown, rebuilt lazily after transforms change */
+    touchswitch_slot_index_t slot_index;
+    std::vector<wayfire_toplevel_view> slot_index_views;
+    bool slot_index_dirty = true;
+    touchswitch_animation_clock_t animation_clock;
+    touchswitch_stats_t stats;
+    /* Counters of the previous activation, once it is torn down */
+    touchswitch_stats_t last_stats;
     wf::option_wrapper_t<int> spacing{"touchswitch/spacing"};
     wf::option_wrapper_t<bool> allow_scale_zoom{"touchswitch/allow_zoom"};
     wf::option_wrapper_t<double> window_scale{"touchswitch/window_scale"};
@@ -112,10 +484,22 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
     wf::option_wrapper_t<std::string> down_action{"touchswitch/pull_down"};
     wf::option_wrapper_t<std::string> background_action{"touchswitch/background_touch"};
     wf::option_wrapper_t<double> flick_motion{"touchswitch/flick_motion"};
-
-    const double velocity_threshold = 0.1; /* The point at which movement is considered stopped, and velocity is zeroed */
-    const double flick_threshold_start = 50; /* The ammount of motion needed to start a flick gesture */
-    const double flick_threshold_end = 20;
+    wf::option_wrapper_t<std::string> layout_option{"touchswitch/layout"};
+    wf::option_wrapper_t<bool> touch_prediction{"touchswitch/touch_prediction"};
+    wf::option_wrapper_t<int> touch_prediction_max{"touchswitch/touch_prediction_max"};
+    wf::option_wrapper_t<std::string> trace_file{"touchswitch/trace_file"};
+    wf::option_wrapper_t<int> activation_budget{"touchswitch/activation_budget"};
+    wf::option_wrapper_t<bool> warm_standby{"touchswitch/warm_standby"};
+    wf::option_wrapper_t<bool> static_thumbnails{"touchswitch/static_thumbnails"};
+    wf::option_wrapper_t<bool> live_center{"touchswitch/live_center"};
+    wf::option_wrapper_t<bool> frame_throttle{"touchswitch/frame_throttle"};
+    wf::option_wrapper_t<int> neighbour_rate{"touchswitch/neighbour_rate"};
+    wf::option_wrapper_t<double> lod_scale{"touchswitch/lod_scale"};
+    wf::option_wrapper_t<int> lod_rate{"touchswitch/lod_rate"};
+
+    /* Layout engine chosen at activation time */
+    std::unique_ptr<touchswitch_layout_t> layout_engine =
+        std::make_unique<touchswitch_carousel_layout_t>();
 
     /* maximum scale -- 1.0 means we will not "zoom in" on a view */
     const double max_scale_factor = 1.0;
@@ -134,6 +518,111 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
 
   public:
     bool active = false;
+    touchswitch_phase_t phase = touchswitch_phase_t::INACTIVE;
+    /* The view chosen by deactivate(), null when closing to the desktop or
+     * if it went away during the exit animation */
+    wayfire_toplevel_view closing_view = nullptr;
+    bool closing_to_desktop = false;
+    touchswitch_latency_t latency;
+
+    /* Note when an activation was requested, before any work for it */
+    void mark_activation_request()
+    {
+        activation_request = latency_clock::now();
+    }
+
+    /* Move the selection to the given slot and stop any motion */
+    bool jump_to_slot(size_t index)
+    {
+        auto views = get_views();
+        if (!active || (index >= views.size()))
+        {
+            return false;
+        }
+
+        input.stop();
+        input.touch_x_offset = index;
+        layout_slots(views);
+        output->render->schedule_redraw();
+        return true;
+    }
+
+    /* Switch to the given slot and close the switcher */
+    bool select_slot(size_t index)
+    {
+        if (!jump_to_slot(index))
+        {
+            return false;
+        }
+
+        deactivate();
+        return true;
+    }
+
+    /* Counters of the running activation, or of the last one */
+    const touchswitch_stats_t& get_counters() const
+    {
+        return active ? stats : last_stats;
+    }
+
+    /* The slots in display order, with their target and current geometry
+     * in output-local coordinates */
+    wf::json_t describe_slots()
+    {
+        wf::json_t slots = wf::json_t::array();
+        if (!active)
+        {
+            return slots;
+        }
+
+        const auto& box_to_json = [] (double x, double y, double width, double height)
+        {
+            wf::json_t geometry;
+            geometry["x"]     = x;
+            geometry["y"]     = y;
+            geometry["width"] = width;
+            geometry["height"] = height;
+            return geometry;
+        };
+
+        auto views  = get_views();
+        auto origin = wf::origin(output->get_layout_geometry());
+        configure_layout();
+        for (size_t j = 0; j < views.size(); j++)
+        {
+            auto view = views[j];
+            auto box  = layout_engine->get_slot_box(j, views.size(), input.touch_x_offset);
+            auto bbox = view->get_transformed_node()->get_bounding_box();
+            wf::json_t slot;
+            slot["index"]    = (int64_t)j;
+            slot["view-id"]  = (int64_t)view->get_id();
+            slot["app-id"]   = view->get_app_id();
+            slot["title"]    = view->get_title();
+            slot["minimized"] = view->minimized;
+            slot["target"]   = box_to_json(box.x, box.y, box.width, box.height);
+            slot["geometry"] = box_to_json(bbox.x - origin.x, bbox.y - origin.y,
+                bbox.width, bbox.height);
+            slots.append(slot);
+        }
+
+        return slots;
+    }
+
+    /* Index of the selected slot, -1 if there is none */
+    long get_selected_index()
+    {
+        if (!active || std::isnan(input.touch_x_offset))
+        {
+            return -1;
+        }
+
+        return get_current_idx();
+    }
+
+    static double ms_since(latency_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(latency_clock::now() - start).count();
+    }
 
     void init() override
     {
@@ -141,23 +630,18 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
         grab     = std::make_unique<wf::input_grab_t>(TOUCHSWITCH_TRANSFORMER, output, this, this, this);
 
         allow_scale_zoom.set_callback(allow_scale_zoom_option_changed);
+        warm_standby.set_callback(warm_standby_option_changed);
 
-
+        on_present.set_callback([=] (void *data)
+        {
+            handle_present((wlr_output_event_present*)data);
+        });
+        on_present.connect(&output->handle->events.present);
 
         show_title.init(output);
         show_icon.init(output);
         output->connect(&update_cb);
-    }
-
-    /* Helper to end swipe velocity */
-    bool is_velocity_zero()
-    {
-        if (std::hypot(velocity.x, velocity.y) > velocity_threshold)
-        {
-            return false;
-        }
-        velocity = {0, 0};
-        return true;
+        output->connect(&on_view_minimized);
     }
 
     /* Variant to create a transform for a fully shown window, animate from current location in scene*/
@@ -166,7 +650,7 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
         {
             return false;
         }
-        auto tr = std::make_shared<wf::scene::view_2d_transformer_t>(view);
+        auto tr = take_transformer(view);
         
         scale_data[view].transformer = tr;
         view->get_transformed_node()->add_transformer(tr, wf::TRANSFORMER_2D + 1,
@@ -176,13 +660,10 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
          * this is a good place to connect the geometry-changed handler */
         view->connect(&view_geometry_changed);
         view->connect(&view_unmapped);
+        view->connect(&view_parent_changed);
 
         set_tiled_wobbly(view, true);
-
-        /* signal that a transformer was added to this view */
-        touchswitch_transformer_added_signal data;
-        data.view = view;
-        output->emit(&data);
+        announce_transformer(view);
 
         return true;
     }
@@ -196,7 +677,7 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
         }
         /* If this is a previously unset transform, animate from bottom of display */
         /* TODO Animation Options */
-        auto tr = std::make_shared<wf::scene::view_2d_transformer_t>(view);
+        auto tr = take_transformer(view);
         
         tr->translation_y=start_y;
         tr->translation_x=start_x;
@@ -211,231 +692,714 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
          * this is a good place to connect the geometry-changed handler */
         view->connect(&view_geometry_changed);
         view->connect(&view_unmapped);
+        view->connect(&view_parent_changed);
 
         set_tiled_wobbly(view, true);
+        announce_transformer(view);
+
+        return true;
+    }
+
+    /* Signal that a transformer was added to this view, so overlays get
+     * attached. While activating this is queued for a later frame */
+    void announce_transformer(wayfire_toplevel_view view)
+    {
+        if (staging)
+        {
+            unannounced.insert(view);
+            staged_work.push_back({view, staged_item_t::ANNOUNCE});
+            return;
+        }
 
-        /* signal that a transformer was added to this view */
         touchswitch_transformer_added_signal data;
         data.view = view;
         output->emit(&data);
-
-        return true;
     }
 
     /* Remove the scale transformer from the view */
     void pop_transformer(wayfire_toplevel_view view)
     {
-        /* signal that a transformer was added to this view */
-        touchswitch_transformer_removed_signal data;
-        data.view = view;
-        output->emit(&data);
+        if (!view->get_transformed_node()->get_transformer(TOUCHSWITCH_TRANSFORMER))
+        {
+            return;
+        }
+
+        /* signal that a transformer was removed from this view, unless
+         * nobody was told it was added */
+        if (!unannounced.erase(view))
+        {
+            touchswitch_transformer_removed_signal data;
+            data.view = view;
+            output->emit(&data);
+        }
+
         view->get_transformed_node()->rem_transformer(TOUCHSWITCH_TRANSFORMER);
         view->disconnect(&view_unmapped);
+        view->disconnect(&view_parent_changed);
         set_tiled_wobbly(view, false);
     }
 
-    /* Remove scale transformers from all views */
-    void remove_transformers()
+    /* A transformer for the view, reusing the one kept in standby if any */
+    std::shared_ptr<wf::scene::view_2d_transformer_t> take_transformer(wayfire_toplevel_view view)
     {
-        for (auto& e : scale_data)
+        auto it = standby.find(view);
+        if (it == standby.end())
         {
-            for (auto& toplevel : e.first->enumerate_views(false))
-            {
-                pop_transformer(toplevel);
-            }
+            return std::make_shared<wf::scene::view_2d_transformer_t>(view);
         }
+
+        auto tr = it->second;
+        standby.erase(it);
+        view->disconnect(&standby_view_unmapped);
+        return tr;
     }
 
-    /* Activate scale, switch activator modes and deactivate */
-    bool handle_toggle()
+    /* Detach the scale transformer from the view, but keep it and the
+     * overlays attached to it for the next activation */
+    void standby_transformer(wayfire_toplevel_view view)
     {
-        if (active)
+        auto tr = view->get_transformed_node()->get_transformer<wf::scene::view_2d_transformer_t>(
+            TOUCHSWITCH_TRANSFORMER);
+        if (!tr)
         {
-            deactivate();
-            return true;
+            return;
         }
-        return activate();
-    }
 
-    wf::signal::connection_t<touchswitch_update_signal> update_cb = [=] (touchswitch_update_signal *ev)
-    {
-        if (active)
+        /* Overlays were never attached if activation had not got to it */
+        if (!unannounced.erase(view))
         {
-            layout_slots(get_views());
-            output->render->schedule_redraw();
+            touchswitch_transformer_standby_signal data;
+            data.view = view;
+            output->emit(&data);
         }
-    };
 
-    void handle_pointer_button(
-        const wlr_pointer_button_event& event) override
-    {
-        process_input(event.button, event.state,
-            wf::get_core().get_cursor_position(), event.time_msec);
+        view->get_transformed_node()->rem_transformer(TOUCHSWITCH_TRANSFORMER);
+        view->disconnect(&view_unmapped);
+        view->disconnect(&view_parent_changed);
+        set_tiled_wobbly(view, false);
+
+        tr->scale_x = tr->scale_y = 1.0;
+        tr->translation_x = tr->translation_y = 0.0;
+        tr->alpha = 1.0;
+        standby[view] = tr;
+        view->connect(&standby_view_unmapped);
     }
 
-    void handle_touch_down(uint32_t time, int finger_id, wf::pointf_t pos) override
+    /* Put the scale transformers of all views in standby */
+    void standby_transformers()
     {
-        if (finger_id == 0)
+        for (auto& e : scale_data)
         {
-            process_input(BTN_LEFT, WLR_BUTTON_PRESSED, pos, time);
+            standby_transformer(e.first);
         }
     }
 
-    void handle_touch_up(uint32_t time, int finger_id,
-        wf::pointf_t lift_off_position) override
+    /* Forget a view in standby, letting overlays release its nodes */
+    void drop_standby(wayfire_toplevel_view view)
     {
-        if (finger_id == 0)
+        if (!standby.erase(view))
         {
-            process_input(BTN_LEFT, WLR_BUTTON_RELEASED, lift_off_position, time);
+            return;
         }
+
+        view->disconnect(&standby_view_unmapped);
+        touchswitch_transformer_removed_signal data;
+        data.view = view;
+        output->emit(&data);
     }
 
-    void handle_touch_motion(uint32_t time, int finger_id,
-        wf::pointf_t position) override
+    /* Forget every view in standby */
+    void drop_standby()
     {
-        if (finger_id == 0)
+        while (!standby.empty())
         {
-            handle_pointer_motion(position, time);
+            drop_standby(standby.begin()->first);
         }
     }
 
-    /* Updates initial view focus variables accordingly */
-    void check_focus_view(wayfire_toplevel_view view)
+    /* Turning warm standby off releases what the last activation kept. While
+     * the switcher is open, finalize() decides once it closes */
+    wf::config::option_base_t::updated_callback_t warm_standby_option_changed = [=] ()
     {
-        if (view == last_selected_view)
+        if (!warm_standby && (phase == touchswitch_phase_t::INACTIVE))
         {
-            last_selected_view = nullptr;
+            drop_standby();
         }
-    }
+    };
 
-    /* Remove transformer from view and remove view from the scale_data map */
-    void remove_view(wayfire_toplevel_view view)
+    wf::signal::connection_t<wf::view_unmapped_signal> standby_view_unmapped =
+        [=] (wf::view_unmapped_signal *ev)
     {
-        if (!view || !scale_data.count(view))
+        if (auto toplevel = wf::toplevel_cast(ev->view))
+        {
+            drop_standby(toplevel);
+        }
+    };
+
+    /* Bring a minimized view into its slot: from its snapshot if it has one,
+     * otherwise by unminimizing it. It is minimized again on close unless
+     * it is chosen */
+    void restore_minimized(wayfire_toplevel_view view)
+    {
+        auto data = scale_data.find(view);
+        if (data == scale_data.end())
         {
+            /* Not in a slot yet, there is no transformer to show it with */
             return;
         }
 
-        for (auto v : view->enumerate_views(false))
+        auto it = snapshot_nodes.find(view);
+        bool shown = (it != snapshot_nodes.end()) && it->second.holds_root;
+        if (!shown && show_snapshot(view, get_snapshot_scale()))
         {
-            check_focus_view(v);
-            pop_transformer(v);
-            scale_data.erase(v);
+            stats.snapshot_slots++;
+        } else if (!shown)
+        {
+            view->set_minimized(false);
+            stats.unminimized_slots++;
         }
+
+        data->second.was_minimized = true;
     }
 
-    /* If in a vertical swipe or end of flick, action any user action here */
-    void handle_window_swipe()
+    /**
+     * Draw a view from its snapshot. Live views are captured now at the
+     * given scale; minimized views use the snapshot taken when they were
+     * minimized, or are captured if the plugin was loaded after that.
+     *
+     * The surfaces are hidden and the client is not told anything. For
+     * minimized views the root node is also enabled, on top of the count
+     * held by the minimize, so it can be drawn at all.
+     *
+     * With lod set, live views are captured filtered, for being shown at a
+     * small fraction of their size.
+     */
+    bool show_snapshot(wayfire_toplevel_view view, float scale, bool lod = false)
     {
-        /* Skip this if possible */
-        if (swipe_direction != swipe_direction_option::VERTICAL)
+        auto it = snapshot_nodes.find(view);
+        if ((it != snapshot_nodes.end()) && !view->minimized && (it->second.lod != lod))
         {
-            return;
-        }
-        /* Vertical swipe only works directly on a window */
-        if (last_selected_view == nullptr)
-        {
-            return;
+            /* The view crossed the level of detail scale */
+            hide_snapshot(view);
+            it = snapshot_nodes.end();
         }
-        auto workarea = output->workarea->get_workarea();
-        std::string action;
 
-        /* TODO User sensitivity? Currently swipe up or down 1/4 of the screen height */
-        if (abs(touch_y_offset) > (workarea.height  / 4.0))
+        if (it != snapshot_nodes.end())
         {
-            if (touch_y_offset < 0)
+            if (view->minimized && !it->second.holds_root)
             {
-                action = up_action;
-            } else
+                /* Minimized while shown as a thumbnail */
+                wf::scene::set_node_enabled(view->get_root_node(), true);
+                it->second.holds_root = true;
+            }
+
+            return true;
+        }
+
+        auto tr = view->get_transformed_node()->get_transformer<wf::scene::view_2d_transformer_t>(
+            TOUCHSWITCH_TRANSFORMER);
+        if (!tr)
+        {
+            return false;
+        }
+
+        lod = lod && !view->minimized;
+        if (!view->minimized || !view->has_data<touchswitch_snapshot_t>())
+        {
+            if (!capture_snapshot(view, scale, lod))
             {
-                action = down_action;
+                return false;
             }
+
+            stats.thumbnail_captures += !view->minimized && !lod;
         }
-        /* TODO other actions */
-        if (action == "close")
+
+        snapshot_slot_t slot;
+        slot.node = std::make_shared<wf::scene::touchswitch_snapshot_node_t>(view);
+        slot.holds_root = view->minimized;
+        slot.lod = lod;
+        wf::scene::add_front(tr, slot.node);
+        wf::scene::set_node_enabled(view->get_surface_root_node(), false);
+        if (slot.holds_root)
         {
-            /* Set non-visible to avoid full-screen flicker of window as it dies */
-            wf::scene::set_node_enabled(last_selected_view->get_root_node(),false);
-            last_selected_view->close();
-        } else if (action == "minimize")
+            wf::scene::set_node_enabled(view->get_root_node(), true);
+        }
+
+        snapshot_nodes[view] = slot;
+        return true;
+    }
+
+    /* Stop drawing a view from its snapshot, minimized views stay minimized */
+    void hide_snapshot(wayfire_toplevel_view view)
+    {
+        auto it = snapshot_nodes.find(view);
+        if (it == snapshot_nodes.end())
         {
-            scale_data[last_selected_view].was_minimized = true;
+            return;
         }
-        /* TODO Consider logging unknown value */
+
+        auto slot = it->second;
+        snapshot_nodes.erase(it);
+        if (slot.node->parent())
+        {
+            wf::scene::remove_child(slot.node);
+        }
+
+        if (slot.holds_root)
+        {
+            wf::scene::set_node_enabled(view->get_root_node(), false);
+        } else if (!view->minimized)
+        {
+            /* A thumbnail is captured again each time it is shown */
+            view->erase_data<touchswitch_snapshot_t>();
+        }
+
+        wf::scene::set_node_enabled(view->get_surface_root_node(), true);
     }
 
-    /* Process button event */
-    void process_input(uint32_t button, uint32_t state, wf::pointf_t input_position, uint32_t time)
+    /* Whether a slot is drawn from thumbnails rather than live */
+    bool wants_thumbnails(wayfire_toplevel_view view)
     {
         if (!active)
+        {
+            return false;
+        }
+
+        bool centre = (view == live_view);
+        if (static_thumbnails)
+        {
+            return !(live_center && centre);
+        }
+
+        return frame_throttle && !centre;
+    }
+
+    /* Whether the centre slot is drawn differently from the others */
+    bool follows_centre()
+    {
+        return (static_thumbnails && live_center) || frame_throttle || (lod_scale > 0);
+    }
+
+    /* Capture a snapshot, filtered if it stands in for a very small view */
+    touchswitch_snapshot_t *capture_snapshot(wayfire_toplevel_view view, float scale, bool lod)
+    {
+        if (!lod)
+        {
+            return touchswitch_capture_snapshot(view, scale);
+        }
+
+        stats.lod_captures++;
+        return touchswitch_capture_filtered_snapshot(view, scale);
+    }
+
+    /**
+     * Draw the views of a slot from snapshots at slot scale, or live again.
+     * Views outside the centre slot shown below touchswitch/lod_scale use
+     * filtered snapshots even when the slot is otherwise live. Minimized
+     * views are always drawn from their snapshot.
+     */
+    void update_slot_snapshots(wayfire_toplevel_view view, const slot_cache_t& slot)
+    {
+        bool thumbnails = wants_thumbnails(view);
+        bool lod_slot   = active && (lod_scale > 0) && (view != live_view);
+        for (size_t i = 0; i < slot.tree.size(); i++)
+        {
+            auto child = slot.tree[i];
+            bool lod   = lod_slot && (slot.scales[i] < lod_scale);
+            if (thumbnails || lod)
+            {
+                show_snapshot(child, output->handle->scale * slot.scales[i], lod);
+            } else if (!child->minimized)
+            {
+                hide_snapshot(child);
+            }
+        }
+    }
+
+    /* Follow the centre slot with the live view as the carousel moves */
+    void update_live_slot()
+    {
+        if (!follows_centre())
         {
             return;
         }
-        if (button != BTN_LEFT)
+
+        auto view = get_current_view();
+        if (view == live_view)
         {
             return;
         }
-        last_touch = input_position;
-        start_touch = input_position;
 
-        /* If a button press or touch-start */
-        if (state == WLR_BUTTON_PRESSED)
+        auto previous = live_view;
+        live_view = view;
+        for (auto v : {previous, view})
         {
-            swipe_direction = swipe_direction_option::UNDECIDED;
-            touch_held = true;
-            velocity = {0, 0};
-            flick_timestamp = 0;
-            auto view = touchswitch_find_view_at(input_position, output);
-            if (view && should_scale_view(view))
+            auto it = v ? slot_cache.find(v) : slot_cache.end();
+            if ((it != slot_cache.end()) && it->second.valid)
             {
-                /* Mark the view as the target of the next input release operation */
-                last_selected_view = view;
-            } else
+                update_slot_snapshots(v, it->second);
+            }
+        }
+    }
+
+    static void send_frame_done(wlr_surface *surface, int, int, void *data)
+    {
+        wlr_surface_send_frame_done(surface, (timespec*)data);
+    }
+
+    /**
+     * Throttled slots are drawn from snapshots, and their clients get no
+     * frame callbacks while their surfaces are hidden. At each tick the
+     * slots on screen are captured again and their clients are allowed
+     * one more frame; slots off screen stay paused. Filtered snapshots are
+     * refreshed the same way, on their own timer.
+     */
+    void refresh_slots(bool lod)
+    {
+        if (std::isnan(input.touch_x_offset) || snapshot_nodes.empty())
+        {
+            return;
+        }
+
+        auto views = get_views();
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        for (size_t j = 0; j < views.size(); j++)
+        {
+            auto cached = slot_cache.find(views[j]);
+            if ((cached == slot_cache.end()) ||
+                is_offscreen(layout_engine->get_slot_box(j, views.size(), input.touch_x_offset)))
             {
-                last_selected_view = nullptr;
+                continue;
             }
 
+            for (auto& view : cached->second.tree)
+            {
+                auto it = snapshot_nodes.find(view);
+                if ((it == snapshot_nodes.end()) || view->minimized || (it->second.lod != lod))
+                {
+                    continue;
+                }
+
+                auto snapshot = view->get_data<touchswitch_snapshot_t>();
+                if (snapshot && capture_snapshot(view, snapshot->scale, lod))
+                {
+                    it->second.node->damage();
+                }
+
+                if (auto surface = view->get_wlr_surface())
+                {
+                    wlr_surface_for_each_surface(surface, send_frame_done, &now);
+                }
+
+                stats.throttled_refreshes += !lod;
+            }
+        }
+    }
+
+    /* Start refreshing throttled slots and filtered snapshots, unless
+     * they are static anyway */
+    void start_refresh_timers()
+    {
+        if (static_thumbnails)
+        {
             return;
         }
 
-        touch_held = false;
+        if (frame_throttle)
+        {
+            throttle_timer.set_timeout(1000 / std::clamp((int)neighbour_rate, 1, 1000), [=] ()
+            {
+                refresh_slots(false);
+                return true;
+            });
+        }
 
-        /* Drag or touch left the dead zone */
-        if (swipe_direction == swipe_direction_option::VERTICAL || swipe_direction == swipe_direction_option::HORIZONTAL)
+        if (lod_scale > 0)
         {
-            /* Try for velocity */
-            if (flick_timestamp > 0 && time > flick_timestamp)
+            lod_timer.set_timeout(1000 / std::clamp((int)lod_rate, 1, 1000), [=] ()
             {
-                uint32_t count_ms = time - flick_timestamp;
-                velocity = start_flick - input_position;
-                velocity = {velocity.x / (double)count_ms, velocity.y /(double)count_ms};
+                refresh_slots(true);
+                return true;
+            });
+        }
+    }
+
+    /* Snapshots are shown at most at the scale of a slot on this output */
+    float get_snapshot_scale()
+    {
+        return output->handle->scale * std::clamp((double)window_scale, 0.1, 1.0);
+    }
+
+    /**
+     * Capture views as they are minimized, while their buffers are still
+     * current, so the next activation can show them without waking the
+     * client. Snapshots of views which are restored are dropped.
+     */
+    wf::signal::connection_t<wf::view_minimized_signal> on_view_minimized =
+        [=] (wf::view_minimized_signal *ev)
+    {
+        auto view = ev->view;
+        if (!view || (view->get_output() != output))
+        {
+            return;
+        }
+
+        if (!ev->state)
+        {
+            /* Someone else restored a view drawn from its snapshot: it is
+             * live again, hiding the snapshot keeps the enable counts even */
+            hide_snapshot(view);
+            view->erase_data<touchswitch_snapshot_t>();
+            return;
+        }
+
+        if (!touchswitch_capture_snapshot(view, get_snapshot_scale()))
+        {
+            return;
+        }
+
+        if (auto it = snapshot_nodes.find(view); it != snapshot_nodes.end())
+        {
+            it->second.node->damage();
+        }
+
+        /* Keep a slot which is on screen from going blank */
+        if ((phase == touchswitch_phase_t::ACTIVE) && scale_data.count(view))
+        {
+            restore_minimized(view);
+        }
+    };
+
+    /* Remove scale transformers from all views. Every view with a
+     * transformer, dialogs included, has its own scale_data entry, so each
+     * transformer is popped exactly once */
+    void remove_transformers()
+    {
+        for (auto& e : scale_data)
+        {
+            pop_transformer(e.first);
+        }
+    }
+
+    /* Activate scale, switch activator modes and deactivate */
+    bool handle_toggle()
+    {
+        if (active)
+        {
+            deactivate();
+            return true;
+        }
+        return activate();
+    }
+
+    wf::signal::connection_t<touchswitch_update_signal> update_cb = [=] (touchswitch_update_signal *ev)
+    {
+        if (active)
+        {
+            layout_slots(get_views());
+            output->render->schedule_redraw();
+        }
+    };
+
+    void handle_pointer_button(
+        const wlr_pointer_button_event& event) override
+    {
+        process_input(event.button, event.state,
+            wf::get_core().get_cursor_position(), event.time_msec);
+    }
+
+    void handle_touch_down(uint32_t time, int finger_id, wf::pointf_t pos) override
+    {
+        if (finger_id == 0)
+        {
+            process_input(BTN_LEFT, WLR_BUTTON_PRESSED, pos, time);
+        }
+    }
+
+    void handle_touch_up(uint32_t time, int finger_id,
+        wf::pointf_t lift_off_position) override
+    {
+        if (finger_id == 0)
+        {
+            process_input(BTN_LEFT, WLR_BUTTON_RELEASED, lift_off_position, time);
+        }
+    }
+
+    void handle_touch_motion(uint32_t time, int finger_id,
+        wf::pointf_t position) override
+    {
+        if (finger_id == 0)
+        {
+            handle_pointer_motion(position, time);
+        }
+    }
+
+    /* Updates initial view focus variables accordingly */
+    void check_focus_view(wayfire_toplevel_view view)
+    {
+        if (view == last_selected_view)
+        {
+            last_selected_view = nullptr;
+        }
+    }
+
+    /* Remove transformer from view and remove view from the scale_data map */
+    void remove_view(wayfire_toplevel_view view)
+    {
+        if (!view || !scale_data.count(view))
+        {
+            return;
+        }
+
+        auto tree = view->enumerate_views(false);
+        auto cached = slot_cache.find(view);
+        if ((cached != slot_cache.end()) && cached->second.valid)
+        {
+            tree = cached->second.tree;
+        }
+
+        for (auto v : tree)
+        {
+            check_focus_view(v);
+            hide_snapshot(v);
+            pop_transformer(v);
+            erase_scale_data(v);
+        }
+
+        if (view == live_view)
+        {
+            live_view = nullptr;
+        }
+
+        slot_cache.erase(view);
+        invalidate_slot(view);
+    }
+
+    /* Drop the cached layout of the slot containing this view */
+    void invalidate_slot(wayfire_toplevel_view view)
+    {
+        auto it = slot_cache.find(wf::find_topmost_parent(view));
+        if (it != slot_cache.end())
+        {
+            it->second.valid = false;
+        }
+    }
+
+    /* Get the cached dialog tree, geometries and scales for a slot, recomputing
+     * them only if the cache was invalidated or the slot size changed */
+    slot_cache_t& get_slot_cache(wayfire_toplevel_view view,
+        double scaled_width, double scaled_height)
+    {
+        auto& slot = slot_cache[view];
+        if (slot.valid &&
+            (slot.scaled_width == scaled_width) &&
+            (slot.scaled_height == scaled_height) &&
+            (slot.allow_zoom == (bool)allow_scale_zoom))
+        {
+            stats.slot_cache_hits++;
+            return slot;
+        }
+
+        stats.slot_cache_misses++;
+
+        /* Helper function to calculate the desired scale for a view */
+        const auto& calculate_scale = [=] (wf::dimensions_t vg)
+        {
+            double w = std::max(1.0, scaled_width);
+            double h = std::max(1.0, scaled_height);
+
+            const double scale = std::min(w / vg.width, h / vg.height);
+            if (!allow_scale_zoom)
+            {
+                return std::min(scale, max_scale_factor);
             }
 
-            if(flick_timestamp==0)
+            return scale;
+        };
+
+        slot.valid = true;
+        slot.scaled_width  = scaled_width;
+        slot.scaled_height = scaled_height;
+        slot.allow_zoom    = allow_scale_zoom;
+        slot.tree = view->enumerate_views(true);
+        slot.geometries.clear();
+        slot.scales.clear();
+
+        auto geom = view->get_geometry();
+        slot.view_scale = calculate_scale({geom.width, geom.height});
+        for (auto& child : slot.tree)
+        {
+            auto vg = child->get_geometry();
+            double scale = calculate_scale({vg.width, vg.height});
+            /* Ensure child is not scaled more than parent */
+            if (!allow_scale_zoom &&
+                (child != view) &&
+                (max_scale_child > 0.0))
             {
-                /* Touch ended and not registered as a flick */
-                touch_x_offset = std::round(touch_x_offset);
-                handle_window_swipe();
-                touch_y_offset = 0.0;
-            } else {
-                /* Touch was a flick on release */
-                double flick_duration = time - flick_timestamp;
-                flick_timestamp = time;
-                velocity = input_position - start_flick;
-                velocity = {velocity.x /flick_duration, velocity.y / flick_duration};
+                scale = std::min(max_scale_child * slot.view_scale, scale);
             }
-            start_flick = {0, 0};
-            last_touch = {0, 0};
-            start_touch = {0, 0};
 
-            layout_slots(get_views());
+            slot.geometries.push_back(vg);
+            slot.scales.push_back(scale);
+        }
+
+        return slot;
+    }
+
+    /* A vertical swipe on a window ended pulled, action the user's choice */
+    void slot_pulled(double dy) override
+    {
+        /* Vertical swipe only works directly on a window */
+        if (last_selected_view == nullptr)
+        {
             return;
         }
-        /* Didn't leave the dead zone, it is 'just' a touch */
+
+        std::string action = (dy < 0) ? up_action : down_action;
+        /* TODO other actions */
+        if (action == "close")
+        {
+            /* Set non-visible to avoid full-screen flicker of window as it dies */
+            wf::scene::set_node_enabled(last_selected_view->get_root_node(),false);
+            last_selected_view->close();
+        } else if (action == "minimize")
+        {
+            scale_data[last_selected_view].was_minimized = true;
+        }
+        /* TODO Consider logging unknown value */
+    }
+
+    /* Process button event */
+    void process_input(uint32_t button, uint32_t state, wf::pointf_t input_position, uint32_t time)
+    {
+        if (!active)
+        {
+            return;
+        }
+        if (button != BTN_LEFT)
+        {
+            return;
+        }
+
+        record_trace((state == WLR_BUTTON_PRESSED) ? TOUCHSWITCH_TRACE_PRESS :
+            TOUCHSWITCH_TRACE_RELEASE, time, input_position);
+        input.button(state == WLR_BUTTON_PRESSED, time, {input_position.x, input_position.y});
+    }
+
+    void select_slot_at(touchswitch_point_t at) override
+    {
+        /* Mark the view as the target of the next input release operation */
+        last_selected_view = find_slot_at({at.x, at.y});
+    }
+
+    /* Didn't leave the dead zone, it is 'just' a touch */
+    void tapped() override
+    {
         if (last_selected_view != nullptr)
         {
             /* Touch a window directly, switch now! */
-            touch_x_offset = get_view_index(last_selected_view);
+            input.touch_x_offset = get_view_index(last_selected_view);
         } else
         {
             /* Touched background, optional actions */
@@ -447,169 +1411,527 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
             /* Set to NaN to make sure no window is raised in finalize */
             if (bg_action == "showdesktop")
             {
-                touch_x_offset = std::numeric_limits<double>::quiet_NaN();
+                input.touch_x_offset = std::numeric_limits<double>::quiet_NaN();
             }
-        }                
+        }
         deactivate();
     }
 
-    /* Handle relative motion input. Should consider velocity of flick as well as mouse/touchscreen */
-    void handle_relative_motion(wf::pointf_t diff, uint32_t time)
+    void relayout() override
+    {
+        layout_slots(get_views());
+    }
+
+    double get_current_time() override
+    {
+        return wf::get_current_time();
+    }
+
+    touchswitch_input_config_t get_input_config() override
+    {
+        touchswitch_input_config_t config;
+        config.flick_motion     = flick_motion;
+        config.touch_prediction = touch_prediction;
+        config.touch_prediction_max = touch_prediction_max;
+        return config;
+    }
+
+    size_t get_slot_count() override
+    {
+        return get_views().size();
+    }
+
+    const touchswitch_layout_t& get_input_layout() override
     {
-        /* These actions should be animated mutually exclusively. Only show the axis with larger difference */
-        if (swipe_direction == swipe_direction_option::VERTICAL)
+        configure_layout();
+        return *layout_engine;
+    }
+
+    double get_workarea_height() override
+    {
+        return output->workarea->get_workarea().height;
+    }
+
+    /* Handle motion input. Should only be mouse/touchscreen.
+     * Several events can arrive per frame, so only record them here and
+     * apply the latest position once per frame in the pre-render hook */
+    void handle_pointer_motion(wf::pointf_t to_f, uint32_t time) override
+    {
+        if (!active)
         {
-            /* Dragging up or down */
-            touch_y_offset += diff.y;
-            layout_slots(get_views());
-        } else if (swipe_direction == swipe_direction_option::HORIZONTAL)
+            return;
+        }
+        bool was_pending = input.has_pending_motion();
+        if (!input.motion(time, {to_f.x, to_f.y}))
+        {
+            return;
+        }
+        stats.motion_events++;
+        record_trace(TOUCHSWITCH_TRACE_MOTION, time, to_f);
+        if (!was_pending)
+        {
+            output->render->schedule_redraw();
+        }
+    }
+
+    /* Start recording the input of this activation, if enabled */
+    void begin_trace(const std::string& layout)
+    {
+        std::string path = trace_file;
+        if (path.empty())
         {
-            /* Dragging left or right */
-            touch_y_offset = 0;
-            auto workarea = output->workarea->get_workarea();
-            const double scaled_width = std::max((double) workarea.width * window_scale, 1.0);
-            /* Account for index-width not screen or window width */
-            double motion_x = (diff.x) / (spacing + scaled_width);
+            return;
+        }
 
-            touch_x_offset -= motion_x;
+        if (!trace.open(path))
+        {
+            LOGE("touchswitch: cannot open trace file ", path);
+            return;
+        }
 
-            /* Force back into bounds if needed, also reset velocity if out of bounds */
-            auto views = get_views();
-            if (touch_x_offset < 0.0)
+        auto workarea = output->workarea->get_workarea();
+        touchswitch_trace_session_t session;
+        session.workarea_x = workarea.x;
+        session.workarea_y = workarea.y;
+        session.workarea_width  = workarea.width;
+        session.workarea_height = workarea.height;
+        session.refresh_hz = 1000.0 / get_frame_ms();
+        session.slots  = get_views().size();
+        session.offset = input.touch_x_offset;
+        session.window_scale = window_scale;
+        session.spacing = spacing;
+        session.flick_motion = flick_motion;
+        session.duration_ms  = animation_clock.get_length_ms();
+        session.touch_prediction = touch_prediction;
+        session.touch_prediction_max = touch_prediction_max;
+        std::strncpy(session.layout, layout.c_str(), sizeof(session.layout) - 1);
+        trace.begin_session(session);
+    }
+
+    /* Record an input event in output-local coordinates */
+    void record_trace(uint32_t kind, uint32_t time, wf::pointf_t at)
+    {
+        if (!trace.is_open())
+        {
+            return;
+        }
+
+        auto offset = wf::origin(output->get_layout_geometry());
+        trace.record(kind, time, at.x - offset.x, at.y - offset.y);
+    }
+
+    /* Rebuild the slot index from the current transformed bounding boxes */
+    void build_slot_index()
+    {
+        slot_index.clear();
+        slot_index_views.clear();
+        std::map<wayfire_toplevel_view, size_t> slots;
+        for (auto& e : scale_data)
+        {
+            auto view = e.first;
+            if (!e.second.transformer || !view->is_mapped() ||
+                !view->get_transformed_node()->is_enabled())
             {
-                touch_x_offset = 0.0;
-                velocity = {0, 0};
-            } else if (touch_x_offset >= (double) (views.size() - 1))
+                continue;
+            }
+
+            auto parent = wf::find_topmost_parent(view);
+            auto it     = slots.find(parent);
+            if (it == slots.end())
             {
-                touch_x_offset = (double) (views.size() - 1);
-                velocity = {0, 0};
+                it = slots.emplace(parent, slot_index_views.size()).first;
+                slot_index_views.push_back(parent);
             }
 
-            layout_slots(views);
+            auto bbox = view->get_transformed_node()->get_bounding_box();
+            slot_index.add({(double)bbox.x, (double)bbox.y,
+                (double)bbox.width, (double)bbox.height}, it->second);
         }
 
+        slot_index.build();
+        slot_index_dirty = false;
     }
 
-    /* Handle motion input. Should only be mouse/touchscreen */
-    void handle_pointer_motion(wf::pointf_t to_f, uint32_t time) override
+    /* Find the slot under a point in global coordinates, returning the
+     * slot's main view. Falls back to walking the scene graph only when no
+     * slot boxes are known */
+    wayfire_toplevel_view find_slot_at(wf::pointf_t at)
     {
-        if (!active)
+        if (slot_index_dirty)
+        {
+            build_slot_index();
+        }
+
+        if (slot_index.empty())
+        {
+            auto view = touchswitch_find_view_at(at, output);
+            if (view && scale_data.count(wf::find_topmost_parent(view)))
+            {
+                return wf::find_topmost_parent(view);
+            }
+
+            return nullptr;
+        }
+
+        auto offset = wf::origin(output->get_layout_geometry());
+        long slot   = slot_index.find(at.x - offset.x, at.y - offset.y);
+        if (slot < 0)
+        {
+            return nullptr;
+        }
+
+        return slot_index_views[slot];
+    }
+
+    /* Length of a frame on this output in milliseconds */
+    double get_frame_ms() override
+    {
+        if (output->handle->refresh > 0)
+        {
+            return 1000000.0 / output->handle->refresh;
+        }
+
+        return 1000.0 / 60.0;
+    }
+
+    /* Track when frames are actually shown, to drive the flick integrator */
+    void handle_present(wlr_output_event_present *ev)
+    {
+        if (!ev->presented)
         {
             return;
         }
-        if (!touch_held)
+
+        if (awaiting_first_present)
+        {
+            /* Both are CLOCK_MONOTONIC. Earlier frames may still be
+             * presented after the first switcher frame was rendered */
+            auto when = latency_clock::time_point(std::chrono::duration_cast<latency_clock::duration>(
+                std::chrono::seconds(ev->when.tv_sec) + std::chrono::nanoseconds(ev->when.tv_nsec)));
+            if (when >= first_frame_time)
+            {
+                awaiting_first_present = false;
+                latency.first_present.add(
+                    std::chrono::duration<double, std::milli>(when - activation_start).count());
+            }
+        }
+
+        /* Same wrapping millisecond clock as wf::get_current_time() */
+        uint64_t msec = (uint64_t)ev->when.tv_sec * 1000 + ev->when.tv_nsec / 1000000;
+        double present_ms = (uint32_t)msec + (ev->when.tv_nsec % 1000000) / 1000000.0;
+        double interval   = (ev->refresh > 0) ? ev->refresh / 1000000.0 : get_frame_ms();
+        stats.flick_missed_frames += input.presented(present_ms, interval);
+    }
+
+    /* Start preparing the slot a flick is predicted to land on while the
+     * carousel is still moving */
+    void flick_predicted(size_t slot) override
+    {
+        stats.flick_predictions++;
+        prefetch_slot(get_views().at(slot));
+    }
+
+    void flick_stopped(bool as_predicted) override
+    {
+        stats.flick_predictions_hit += as_predicted;
+    }
+
+    /* Get a slot ready to be interacted with before it is reached */
+    void prefetch_slot(wayfire_toplevel_view view)
+    {
+        if (staged_slots.count(view))
+        {
+            /* Left for a later stage, lay it out now as the stage would */
+            auto views = get_views();
+            configure_layout();
+            forced_slot = view;
+            layout_slot(view, get_view_index(view), views.size());
+            forced_slot = nullptr;
+            dirty_slots.insert(view);
+        } else if (view->minimized)
+        {
+            restore_minimized(view);
+        }
+
+        /* Let the overlays load their resources for it now */
+        touchswitch_prefetch_signal data;
+        data.view = view;
+        output->emit(&data);
+    }
+
+    /* Returns the index of a given view, assert if not in get_views*/
+    size_t get_view_index(wayfire_toplevel_view view)
+    {
+        auto views = get_views();
+        auto iterator_focused = std::find(views.begin(), views.end(), view);
+        wf::dassert(iterator_focused != views.end(), "Chosen view not in list!");
+        return iterator_focused - views.begin();
+    }
+
+    /* Get the view at given index, returns nullptr if out of bounds */
+    wayfire_toplevel_view get_view(size_t idx)
+    {
+        if (idx < 0 || idx >= get_views().size())
+        {
+            return nullptr;
+        }
+        return get_views().at(idx);
+    }
+
+    /* Return the selected current window, if offset is NaN at this point return null */
+    wayfire_toplevel_view get_current_view()
+    {
+        if (std::isnan(input.touch_x_offset))
+        {
+            return nullptr;
+        }
+        return get_view(get_current_idx());
+    }
+
+    /* Get the current 'selected' middle slot index */
+    size_t get_current_idx()
+    {
+        wf::dassert(!std::isnan(input.touch_x_offset), "X offset NaN");
+        return std::roundl(input.touch_x_offset);
+    }
+
+    /* Modifiers which leave key presses to the switcher: shift for typing,
+     * and the locks, CapsLock and NumLock (mod2), which are often left on */
+    const uint32_t typing_modifiers =
+        WLR_MODIFIER_SHIFT | WLR_MODIFIER_CAPS | WLR_MODIFIER_MOD2;
+
+    /* Process key event */
+    void handle_keyboard_key(wf::seat_t*, wlr_keyboard_key_event ev) override
+    {
+        if ((ev.state != WLR_KEY_PRESSED) ||
+            (wf::get_core().seat->get_keyboard_modifiers() & ~typing_modifiers))
         {
             return;
         }
-        if (std::hypot(start_touch.x - to_f.x, start_touch.y - to_f.y) > 40.0){
-            auto total_diff = to_f - start_touch;
-            auto diff = to_f - last_touch;
-            double total_distance = std::hypot(total_diff.x, total_diff.y);
-            /* Check if we've commited to a gesture */
-            if (swipe_direction == swipe_direction_option::UNDECIDED && total_distance > 50)
+        auto view_count = get_views().size();
+
+        switch (ev.keycode)
+        {
+          case KEY_BACKSPACE:
+            if (!filter_query.empty())
             {
-                if (abs(total_diff.y) > abs(total_diff.x))
-                {
-                    swipe_direction = swipe_direction_option::VERTICAL;
-                } else
-                {
-                    swipe_direction = swipe_direction_option::HORIZONTAL;
-                }
+                std::string query = filter_query;
+                query.pop_back();
+                set_filter(query);
             }
-            double distance = std::hypot(diff.x, diff.y);
-            if(distance > flick_threshold_start && flick_timestamp == 0)
+
+            return;
+
+          case KEY_ESC:
+            if (!filter_query.empty())
             {
-                /* Flick started */
-                flick_timestamp = time;
-                start_flick = to_f;
-            } else if(distance <= flick_threshold_end)
+                set_filter("");
+            }
+
+            return;
+
+          case KEY_LEFT:
+            input.touch_x_offset-=1.0;
+            if (input.touch_x_offset < 0.0)
+            {
+                input.touch_x_offset = 0.0;
+            }
+            break;
+          case KEY_RIGHT:
+            input.touch_x_offset+=1.0;
+            if(input.touch_x_offset >= (view_count - 1))
             {
-                /* Flick reset */
-                flick_timestamp = 0;
-                start_flick = {0,0};
+                input.touch_x_offset = view_count - 1;
             }
-            handle_relative_motion(diff, time);
-            last_touch = to_f;
+            break;
+
+          case KEY_UP:
+          case KEY_DOWN:
+          {
+            configure_layout();
+            double stride = layout_engine->get_row_stride(view_count);
+            if (stride == 0.0)
+            {
+                return;
+            }
+
+            input.touch_x_offset += (ev.keycode == KEY_UP) ? -stride : stride;
+            input.touch_x_offset  = std::clamp(input.touch_x_offset, 0.0, view_count - 1.0);
+            break;
+          }
+
+          case KEY_ENTER:
+            deactivate();
+            return;
+
+          default:
+          {
+            /* Anything printable narrows the filter */
+            std::string text = get_key_text(ev.keycode);
+            if (!text.empty())
+            {
+                set_filter(filter_query + text);
+            }
+
+            return;
+          }
+        }
+
+        auto view = get_current_view();
+        if (view)
+        {
+            layout_slots(get_views());
+        }
+    }
+
+    /* Text typed by a key, lowercased, or empty if it is not printable */
+    std::string get_key_text(uint32_t keycode)
+    {
+        auto keyboard = wlr_seat_get_keyboard(wf::get_core().get_current_seat());
+        if (!keyboard || !keyboard->xkb_state)
+        {
+            return "";
+        }
+
+        char buffer[16];
+        /* xkb keycodes are offset by 8 from evdev ones */
+        int len = xkb_state_key_get_utf8(keyboard->xkb_state, keycode + 8, buffer, sizeof(buffer));
+        if ((len <= 0) || ((unsigned char)buffer[0] < 0x20) || (buffer[0] == 0x7f))
+        {
+            return "";
         }
+
+        return to_lower(std::string(buffer, std::min<int>(len, sizeof(buffer) - 1)));
     }
 
+    static std::string to_lower(std::string text)
+    {
+        std::transform(text.begin(), text.end(), text.begin(),
+            [] (unsigned char c) { return std::tolower(c); });
+        return text;
+    }
 
-    /* Returns the index of a given view, assert if not in get_views*/
-    size_t get_view_index(wayfire_toplevel_view view)
+    /* Text a view is matched against when filtering */
+    std::string get_search_text(wayfire_toplevel_view view)
     {
-        auto views = get_views();
-        auto iterator_focused = std::find(views.begin(), views.end(), view);
-        wf::dassert(iterator_focused != views.end(), "Chosen view not in list!");
-        return iterator_focused - views.begin();
+        return to_lower(view->get_title() + "\n" + view->get_app_id());
     }
 
-    /* Get the view at given index, returns nullptr if out of bounds */
-    wayfire_toplevel_view get_view(size_t idx)
+    /* Whether a view matches the current filter */
+    bool filter_accepts(wayfire_toplevel_view view)
     {
-        if (idx < 0 || idx >= get_views().size())
+        if (filter_query.empty())
         {
-            return nullptr;
+            return true;
         }
-        return get_views().at(idx);
-    }
 
-    /* Return the selected current window, if offset is NaN at this point return null */
-    wayfire_toplevel_view get_current_view()
-    {
-        if (std::isnan(touch_x_offset))
+        auto it = search_index.find(view);
+        if (it == search_index.end())
         {
-            return nullptr;
+            it = search_index.emplace(view, get_search_text(view)).first;
         }
-        return get_view(get_current_idx());
+
+        return it->second.find(filter_query) != std::string::npos;
     }
 
-    /* Get the current 'selected' middle slot index */
-    size_t get_current_idx()
+    /* Show or hide a slot's views while filtering */
+    void set_slot_filtered(wayfire_toplevel_view view, bool filtered)
     {
-        wf::dassert(!std::isnan(touch_x_offset), "X offset NaN");
-        return std::roundl(touch_x_offset);
+        for (auto v : view->enumerate_views(false))
+        {
+            wf::scene::set_node_enabled(v->get_transformed_node(), !filtered);
+        }
+
+        if (filtered)
+        {
+            filtered_out.insert(view);
+        } else
+        {
+            filtered_out.erase(view);
+        }
+
+        slot_index_dirty = true;
     }
 
-    /* Process key event */
-    void handle_keyboard_key(wf::seat_t*, wlr_keyboard_key_event ev) override
+    /**
+     * Change the filter query. A query extending the previous one only needs
+     * to check the previous matches, and only slots whose visibility changed
+     * are shown or hidden. Keystrokes which would leave no match are ignored.
+     */
+    void set_filter(const std::string& query)
     {
-        if ((ev.state != WLR_KEY_PRESSED) ||
-            wf::get_core().seat->get_keyboard_modifiers())
+        auto all = get_unfiltered_views();
+        if (search_index.empty() && !query.empty())
         {
-            return;
+            for (auto& view : all)
+            {
+                search_index.emplace(view, get_search_text(view));
+            }
         }
-        auto view_count = get_views().size();
 
-        switch (ev.keycode)
-        {
+        bool narrowing = !filter_query.empty() &&
+            (query.compare(0, filter_query.size(), filter_query) == 0);
+        std::string previous = filter_query;
+        filter_query = query;
 
-          case KEY_LEFT:
-            touch_x_offset-=1.0;
-            if (touch_x_offset < 0.0)
+        std::vector<wayfire_toplevel_view> matches;
+        for (auto& view : all)
+        {
+            if (narrowing && filtered_out.count(view))
             {
-                touch_x_offset = 0.0;
+                /* Did not match the shorter query, cannot match this one */
+                continue;
             }
-            break;
-          case KEY_RIGHT:
-            touch_x_offset+=1.0;
-            if(touch_x_offset >= (view_count - 1))
+
+            if (filter_accepts(view))
             {
-                touch_x_offset = view_count - 1;
+                matches.push_back(view);
             }
-            break;
+        }
 
-          case KEY_ENTER:
-            deactivate();
+        if (matches.empty())
+        {
+            filter_query = previous;
             return;
+        }
 
-          default:
+        auto current = get_current_view();
+        std::set<wayfire_toplevel_view> matched(matches.begin(), matches.end());
+        for (auto& view : all)
+        {
+            bool filtered = !matched.count(view);
+            if (filtered != (bool)filtered_out.count(view))
+            {
+                set_slot_filtered(view, filtered);
+            }
+        }
+
+        /* Stay on the same view if it is still shown, otherwise the first match */
+        auto it = std::find(matches.begin(), matches.end(), current);
+        input.touch_x_offset = (it != matches.end()) ? it - matches.begin() : 0;
+        layout_slots(get_views());
+    }
+
+    /* Drop the filter and show every slot again, keeping the selection */
+    void clear_filter()
+    {
+        if (filter_query.empty() && filtered_out.empty())
+        {
+            search_index.clear();
             return;
         }
 
-        auto view = get_current_view();
-        if (view)
+        auto current = get_current_view();
+        for (auto view : std::set<wayfire_toplevel_view>(filtered_out))
         {
-            layout_slots(get_views());
+            set_slot_filtered(view, false);
+        }
+
+        filter_query.clear();
+        search_index.clear();
+        if (current)
+        {
+            input.touch_x_offset = get_view_index(current);
         }
     }
 
@@ -625,25 +1947,22 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
                 continue;
             }
 
-            if (view_data.animation.scale_animation.running())
+            auto& animation = view_data.animation;
+            if (animation.running())
             {
-                view->get_transformed_node()->begin_transform_update();
-                view_data.transformer->scale_x =
-                    view_data.animation.scale_animation.scale_x;
-                view_data.transformer->scale_y =
-                    view_data.animation.scale_animation.scale_y;
-                view_data.transformer->translation_x =
-                    view_data.animation.scale_animation.translation_x;
-                view_data.transformer->translation_y =
-                    view_data.animation.scale_animation.translation_y;
-
-                view->get_transformed_node()->end_transform_update();
+                animation.tick(animation_clock, wf::dimensions(view->get_geometry()));
+                transform_batch.set(view, view_data.transformer,
+                    animation.scale_x.value, animation.scale_y.value,
+                    animation.translation_x.value, animation.translation_y.value);
             }
         }
+
+        transform_batch.commit(output, stats);
+        slot_index_dirty = true;
     }
 
-    /* Returns a list of views to be scaled */
-    std::vector<wayfire_toplevel_view> get_views()
+    /* Returns a list of views to be scaled, ignoring any filter */
+    std::vector<wayfire_toplevel_view> get_unfiltered_views()
     {
         std::vector<wayfire_toplevel_view> views = output->wset()->get_views(
             wf::WSET_MAPPED_ONLY);
@@ -654,6 +1973,19 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
         return views;
     }
 
+    /* Returns a list of views to be scaled */
+    std::vector<wayfire_toplevel_view> get_views()
+    {
+        auto views = get_unfiltered_views();
+        if (!filtered_out.empty())
+        {
+            views.erase(std::remove_if(views.begin(), views.end(),
+                [=] (auto view) { return filtered_out.count(view) > 0; }), views.end());
+        }
+
+        return views;
+    }
+
     /**
      * @return true if the view is to be scaled.
      */
@@ -675,24 +2007,17 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
     {
         /* If the user is actively dragging or flicking it then set it directly.
            Animating after the drag feels like really bad input lag */
-        if (touch_held || !is_velocity_zero()){
-            view->get_transformed_node()->begin_transform_update();
-            view_data.transformer->scale_x = scale_x;
-            view_data.transformer->scale_y = scale_y;
-            view_data.transformer->translation_x = translation_x;
-            view_data.transformer->translation_y = translation_y;
-            view->get_transformed_node()->end_transform_update();
+        if (input.is_tracking()){
+            /* Damage is pushed by the next transform_views() */
+            view_data.animation.warp(animation_clock, scale_x, scale_y, translation_x, translation_y);
+            transform_batch.set(view, view_data.transformer,
+                scale_x, scale_y, translation_x, translation_y);
             return;
         }
-        view_data.animation.scale_animation.scale_x.set(
-            view_data.transformer->scale_x, scale_x);
-        view_data.animation.scale_animation.scale_y.set(
-            view_data.transformer->scale_y, scale_y);
-        view_data.animation.scale_animation.translation_x.set(
-            view_data.transformer->translation_x, translation_x);
-        view_data.animation.scale_animation.translation_y.set(
-            view_data.transformer->translation_y, translation_y);
-        view_data.animation.scale_animation.start();
+
+        /* Retarget the springs, keeping any motion already in progress */
+        view_data.animation.animate(animation_clock, *view_data.transformer,
+            scale_x, scale_y, translation_x, translation_y);
     }
 
     /* Compute target scale layout geometry for all the view transformers
@@ -711,114 +2036,282 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
             return;
         }
 
-        auto workarea = output->workarea->get_workarea();
+        stats.layouts++;
+        configure_layout();
+        update_live_slot();
+        for (size_t j = 0; j < views.size(); j++)
+        {
+            layout_slot(views[j], j, views.size());
+        }
 
-        const double scaled_height = std::max((double)
-            workarea.height * window_scale, 1.0);
-        const double scaled_width = std::max((double)
-            workarea.width * window_scale, 1.0);
+        dirty_slots.clear();
+        set_hook();
+        transform_views();
+    }
 
-        const double workarea_center_x = workarea.width / 2.0;
-        const double workarea_center_y = workarea.height / 2.0;
+    /* Do deferred activation work until the per-frame budget is used up */
+    void run_activation_stage()
+    {
+        if (!staging)
+        {
+            return;
+        }
 
-        const double offset_x = workarea.x - (scaled_width / 2.0) + workarea_center_x;
-        const double offset_y = workarea.y - (scaled_height / 2.0) + workarea_center_y;
+        if (staging_first_frame)
+        {
+            /* Let the first frame show with slot transforms only */
+            staging_first_frame = false;
+            output->render->schedule_redraw();
+            return;
+        }
 
+        auto views = get_views();
+        std::map<wayfire_toplevel_view, size_t> index;
         for (size_t j = 0; j < views.size(); j++)
         {
+            index[views[j]] = j;
+        }
+
+        /* Nearest to the selection first, the selection may have moved */
+        const auto& distance = [&] (wayfire_toplevel_view view)
+        {
+            auto it = index.find(wf::find_topmost_parent(view));
+            return (it == index.end()) ? std::numeric_limits<double>::infinity() :
+                   std::abs(it->second - input.touch_x_offset);
+        };
+        std::stable_sort(staged_work.begin(), staged_work.end(),
+            [&] (const staged_item_t& a, const staged_item_t& b)
+        {
+            return distance(a.view) < distance(b.view);
+        });
 
-            wayfire_toplevel_view view = views[j];
-            double index_position = (double)(j) - touch_x_offset;
-            double x = offset_x +  (spacing + scaled_width) * index_position;
-            double y = offset_y;
-            if (last_selected_view != nullptr && view == last_selected_view)
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::duration<double, std::milli> budget((int)activation_budget);
+        size_t done = 0;
+        while (done < staged_work.size())
+        {
+            auto item = staged_work[done++];
+            stats.staged_items++;
+            if (item.kind == staged_item_t::SLOT)
             {
-                y += touch_y_offset;
-            }
-            
-            /* Calculate current transformation of the view, in order to
-               ensure that new views in the view tree start directly at the
-               correct position */
-            double main_view_dx    = 0;
-            double main_view_dy    = 0;
-            double main_view_scale = 1.0;
-            if (scale_data.count(view))
+                auto it = index.find(item.view);
+                if (staged_slots.count(item.view) && (it != index.end()))
+                {
+                    /* The first pass adds the transformers, the dirty pass
+                     * this frame restores the view, as on activation */
+                    forced_slot = item.view;
+                    layout_slot(item.view, it->second, views.size());
+                    forced_slot = nullptr;
+                    dirty_slots.insert(item.view);
+                }
+            } else if (item.kind == staged_item_t::CAPTURE)
             {
-                main_view_dx    = scale_data[view].transformer->translation_x;
-                main_view_dy    = scale_data[view].transformer->translation_y;
-                main_view_scale = scale_data[view].transformer->scale_x;
-
-                if (view->minimized)
+                auto it = slot_cache.find(item.view);
+                if (staged_captures.erase(item.view) && (it != slot_cache.end()) &&
+                    it->second.valid)
                 {
-                    view->set_minimized(false);
-                    scale_data[view].was_minimized = true;
+                    update_slot_snapshots(item.view, it->second);
                 }
+            } else if (unannounced.erase(item.view) && scale_data.count(item.view))
+            {
+                touchswitch_transformer_added_signal data;
+                data.view = item.view;
+                output->emit(&data);
             }
 
-            /* Helper function to calculate the desired scale for a view */
-            const auto& calculate_scale = [=] (wf::dimensions_t vg)
+            if (std::chrono::steady_clock::now() - start >= budget)
             {
-                double w = std::max(1.0, scaled_width);
-                double h = std::max(1.0, scaled_height);
+                break;
+            }
+        }
 
-                const double scale = std::min(w / vg.width, h / vg.height);
-                if (!allow_scale_zoom)
-                {
-                    return std::min(scale, max_scale_factor);
-                }
+        staged_work.erase(staged_work.begin(), staged_work.begin() + done);
+        stats.staged_frames++;
+        if (staged_work.empty())
+        {
+            staging = false;
+        } else
+        {
+            output->render->schedule_redraw();
+        }
+    }
+
+    /* Stop staging, work not done yet is no longer needed */
+    void end_activation_stages()
+    {
+        staging = false;
+        staging_first_frame = false;
+        staged_work.clear();
+        staged_slots.clear();
+        staged_captures.clear();
+    }
 
-                return scale;
-            };
+    /* Relayout only the slots marked dirty since the last frame */
+    void layout_dirty_slots()
+    {
+        auto views = get_views();
+        if (!views.size())
+        {
+            dirty_slots.clear();
+            if (active)
+            {
+                deactivate();
+            }
 
-            
-            add_transformer(view, (spacing + scaled_width) * index_position, offset_y+workarea.height);
-            auto geom = view->get_geometry();
-            double view_scale = calculate_scale({geom.width, geom.height});
-            for (auto& child : view->enumerate_views(true))
+            return;
+        }
+
+        stats.layouts++;
+        configure_layout();
+        for (size_t j = 0; j < views.size(); j++)
+        {
+            if (dirty_slots.count(views[j]))
             {
-                /* Ensure a transformer for the view, and make sure that
-                   new views in the view tree start off with the correct
-                   attributes set. */
-                auto new_child   = add_transformer(child, (spacing + scaled_width) * index_position, offset_y+workarea.height);
-                auto& child_data = scale_data[child];
-                if (new_child)
-                {
-                    child_data.transformer->translation_x = main_view_dx;
-                    child_data.transformer->translation_y = main_view_dy;
-                    child_data.transformer->scale_x = main_view_scale;
-                    child_data.transformer->scale_y = main_view_scale;
-                }
+                layout_slot(views[j], j, views.size());
+            }
+        }
 
-                if (!active)
-                {
-                    /* On exit, we just animate towards normal state */
-                    setup_view_transform(view, child_data, 1, 1, 0, 0);
-                    continue;
-                }
+        dirty_slots.clear();
+    }
+
+    /* Feed the current workarea and options to the layout engine */
+    void configure_layout()
+    {
+        auto workarea = output->workarea->get_workarea();
+        layout_engine->configure({(double)workarea.x, (double)workarea.y,
+            (double)workarea.width, (double)workarea.height}, window_scale, spacing);
+    }
 
-                auto vg = child->get_geometry();
-                wf::pointf_t center = {vg.x + vg.width / 2.0, vg.y + vg.height / 2.0};
+    /* Whether a slot at the given box is left for a later activation stage.
+     * Restoring minimized views without a snapshot is the expensive part, so
+     * only those are deferred, and only while they are off-screen */
+    bool should_defer_slot(wayfire_toplevel_view view, const touchswitch_box_t& box)
+    {
+        if (!staging || !view->minimized || scale_data.count(view) || (view == forced_slot) ||
+            view->has_data<touchswitch_snapshot_t>())
+        {
+            return false;
+        }
 
-                /* Take padding into account */
-                double scale = calculate_scale({vg.width, vg.height});
-                /* Ensure child is not scaled more than parent */
-                if (!allow_scale_zoom &&
-                    (child != view) &&
-                    (max_scale_child > 0.0))
-                {
-                    scale = std::min(max_scale_child * view_scale, scale);
-                }
+        return is_offscreen(box);
+    }
 
-                /* Start the animation */
-                const double dx = x - center.x + scaled_width / 2.0;
-                const double dy = y - center.y + scaled_height / 2.0;
-                setup_view_transform(view, child_data, scale, scale,
-                    dx, dy);
+    /* Whether capturing the thumbnails of a slot at the given box is left
+     * for a later activation stage, which it is while it is off-screen */
+    bool should_defer_capture(wayfire_toplevel_view view, const touchswitch_box_t& box)
+    {
+        if (!staging || (view == forced_slot))
+        {
+            return false;
+        }
+
+        return is_offscreen(box);
+    }
+
+    /* Whether a slot box is entirely outside of the output */
+    bool is_offscreen(const touchswitch_box_t& box)
+    {
+        auto og = output->get_relative_geometry();
+        return (box.x + box.width <= og.x) || (box.x >= og.x + og.width) ||
+               (box.y + box.height <= og.y) || (box.y >= og.y + og.height);
+    }
+
+    /* Compute the target transform of a single slot at index j */
+    void layout_slot(wayfire_toplevel_view view, size_t j, size_t count)
+    {
+        auto box = layout_engine->get_slot_box(j, count, input.touch_x_offset);
+        if (should_defer_slot(view, box))
+        {
+            if (staged_slots.insert(view).second)
+            {
+                staged_work.push_back({view, staged_item_t::SLOT});
             }
+
+            return;
         }
 
-        set_hook();
-        transform_views();
+        staged_slots.erase(view);
+        const double scaled_width  = box.width;
+        const double scaled_height = box.height;
+        auto workarea = output->workarea->get_workarea();
+
+        /* Where a newly shown slot starts animating from, below the workarea */
+        const double start_x = box.x + box.width / 2.0 - (workarea.x + workarea.width / 2.0);
+        const double start_y = box.y + workarea.height;
+
+        double x = box.x;
+        double y = box.y;
+        if (last_selected_view != nullptr && view == last_selected_view)
+        {
+            y += input.touch_y_offset;
+        }
+
+        /* Calculate current transformation of the view, in order to
+           ensure that new views in the view tree start directly at the
+           correct position */
+        double main_view_dx    = 0;
+        double main_view_dy    = 0;
+        double main_view_scale = 1.0;
+        if (scale_data.count(view))
+        {
+            main_view_dx    = scale_data[view].transformer->translation_x;
+            main_view_dy    = scale_data[view].transformer->translation_y;
+            main_view_scale = scale_data[view].transformer->scale_x;
+        }
+
+        add_transformer(view, start_x, start_y);
+        if (view->minimized)
+        {
+            restore_minimized(view);
+        }
+
+        auto& slot = get_slot_cache(view, scaled_width, scaled_height);
+        for (size_t i = 0; i < slot.tree.size(); i++)
+        {
+            auto child = slot.tree[i];
+            /* Ensure a transformer for the view, and make sure that
+               new views in the view tree start off with the correct
+               attributes set. */
+            auto new_child   = add_transformer(child, start_x, start_y);
+            auto& child_data = scale_data[child];
+            if (new_child)
+            {
+                child_data.transformer->translation_x = main_view_dx;
+                child_data.transformer->translation_y = main_view_dy;
+                child_data.transformer->scale_x = main_view_scale;
+                child_data.transformer->scale_y = main_view_scale;
+            }
+
+            if (!active)
+            {
+                /* On exit, we just animate towards normal state */
+                setup_view_transform(child, child_data, 1, 1, 0, 0);
+                continue;
+            }
+
+            auto& vg = slot.geometries[i];
+            wf::pointf_t center = {vg.x + vg.width / 2.0, vg.y + vg.height / 2.0};
+            double scale = slot.scales[i];
+
+            /* Start the animation */
+            const double dx = x - center.x + scaled_width / 2.0;
+            const double dy = y - center.y + scaled_height / 2.0;
+            setup_view_transform(child, child_data, scale, scale,
+                dx, dy);
+        }
+
+        if (active && should_defer_capture(view, box))
+        {
+            if (staged_captures.insert(view).second)
+            {
+                staged_work.push_back({view, staged_item_t::CAPTURE});
+            }
+
+            return;
+        }
+
+        staged_captures.erase(view);
+        update_slot_snapshots(view, slot);
     }
 
     /* Toggle between restricting maximum scale to 100% or allowing it
@@ -837,11 +2330,26 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
 
     void handle_new_view(wayfire_toplevel_view view)
     {
+        if (!view->parent && !filter_accepts(view))
+        {
+            /* Keep new views which do not match the filter out of the switcher */
+            set_slot_filtered(view, true);
+            return;
+        }
+
+        if (view->parent && filtered_out.count(wf::find_topmost_parent(view)))
+        {
+            wf::scene::set_node_enabled(view->get_transformed_node(), false);
+            return;
+        }
+
         if (!should_scale_view(view))
         {
             return;
         }
-        
+
+        /* A new dialog changes the tree of its slot */
+        invalidate_slot(view);
         layout_slots(get_views());
     }
 
@@ -859,10 +2367,42 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
 
     void handle_view_unmapped(wayfire_toplevel_view view)
     {
+        if (phase == touchswitch_phase_t::CLOSING)
+        {
+            /* Let go of the view, the exit animation carries on without it */
+            check_focus_view(view);
+            remove_view(view);
+            if (view == closing_view)
+            {
+                closing_view = nullptr;
+            }
+
+            return;
+        }
+
         if (!active)
         {
             return;
         }
+        search_index.erase(view);
+        if (filtered_out.count(view))
+        {
+            /* Its nodes must be shown again wherever it turns up next */
+            set_slot_filtered(view, false);
+        } else if (view->parent && filtered_out.count(wf::find_topmost_parent(view)))
+        {
+            /* A dialog of a filtered slot, hidden on its own when it mapped */
+            wf::scene::set_node_enabled(view->get_transformed_node(), true);
+        }
+
+        auto shown = get_views();
+        if (!filtered_out.empty() &&
+            std::none_of(shown.begin(), shown.end(), [=] (auto v) { return v != view; }))
+        {
+            /* The last match is going away, show everything again */
+            clear_filter();
+        }
+
         remove_view(view);
         if (scale_data.empty())
         {
@@ -870,9 +2410,9 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
         } else if (!view->parent)
         {
             /* If we're over the bounds now, move back in */
-            if (touch_x_offset >= (double) (get_views().size() - 1))
+            if (input.touch_x_offset >= (double) (get_views().size() - 1))
             {
-                touch_x_offset = (double) (get_views().size() - 1) ;
+                input.touch_x_offset = (double) (get_views().size() - 1) ;
             }
             layout_slots(get_views());
         }
@@ -899,7 +2439,9 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
         layout_slots(get_views());
     };
 
-    /* View geometry changed. Also called when workspace changes */
+    /* View geometry changed. Also called when workspace changes.
+     * Clients may resize many times per frame, so only mark the slot dirty
+     * and relayout it once in the pre-render hook */
     wf::signal::connection_t<wf::view_geometry_changed_signal> view_geometry_changed =
         [=] (wf::view_geometry_changed_signal *ev)
     {
@@ -907,22 +2449,34 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
         {
             return;
         }
-        auto views = get_views();
-        if (!views.size())
+        if (auto toplevel = wf::toplevel_cast(ev->view))
         {
-            deactivate();
+            invalidate_slot(toplevel);
+            dirty_slots.insert(wf::find_topmost_parent(toplevel));
+            output->render->schedule_redraw();
+        }
+    };
 
-            return;
+    /* A dialog was attached to or detached from some slot's tree */
+    wf::signal::connection_t<wf::view_parent_changed_signal> view_parent_changed =
+        [=] (wf::view_parent_changed_signal *ev)
+    {
+        /* The previous parent is not known here, so drop every cached tree */
+        for (auto& e : slot_cache)
+        {
+            e.second.valid = false;
         }
 
-        layout_slots(std::move(views));
+        if (active)
+        {
+            layout_slots(get_views());
+        }
     };
 
-
     /* View unmapped */
     wf::signal::connection_t<wf::view_unmapped_signal> view_unmapped = [=] (wf::view_unmapped_signal *ev)
     {
-        if (!active)
+        if ((phase != touchswitch_phase_t::ACTIVE) && (phase != touchswitch_phase_t::CLOSING))
         {
             return;
         }
@@ -933,56 +2487,64 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
         }
     };
 
-    /* Returns true if any scale animation is running */
-    bool animation_running()
-    {
-        for (auto& e : scale_data)
+    /* Returns true if any scale animation is running */
+    bool animation_running()
+    {
+        return animation_clock.running > 0;
+    }
+
+    /* Forget a view, taking its animation off the clock */
+    void erase_scale_data(wayfire_toplevel_view view)
+    {
+        auto it = scale_data.find(view);
+        if (it == scale_data.end())
+        {
+            return;
+        }
+
+        auto& tr = it->second.transformer;
+        if (tr)
         {
-            if (e.second.animation.scale_animation.running())
-            {
-                return true;
-            }
+            it->second.animation.warp(animation_clock, tr->scale_x, tr->scale_y,
+                tr->translation_x, tr->translation_y);
         }
 
-        return false;
+        scale_data.erase(it);
+        slot_index_dirty = true;
     }
 
     /* Assign transform values to the actual transformer */
     wf::effect_hook_t pre_hook = [=] ()
     {
+        if (awaiting_first_frame)
+        {
+            awaiting_first_frame = false;
+            latency.first_frame.add(ms_since(activation_start));
+            first_frame_time = latency_clock::now();
+            awaiting_first_present = true;
+        }
+
+        animation_clock.tick((input.present_interval_ms > 0) ? input.present_interval_ms : get_frame_ms());
+        if (active)
+        {
+            input.flush_motion();
+            run_activation_stage();
+            update_live_slot();
+        }
+
+        if (active && !dirty_slots.empty())
+        {
+            layout_dirty_slots();
+        }
+
         transform_views();
     };
 
     /* Keep rendering until all animation has finished */
     wf::effect_hook_t post_hook = [=] ()
     {
-        bool running = animation_running() || !is_velocity_zero();
-        if(!touch_held && !is_velocity_zero())
-        {
-            /* Apply friction */
-            auto workarea = output->workarea->get_workarea();
-            velocity = {velocity.x * flick_motion, velocity.y * flick_motion};
-            if(is_velocity_zero() || abs(touch_y_offset) > (workarea.height  / 4.0))
-            {
-                /* Was moving, now isn't. */
-                handle_window_swipe(); /* Account for actions on vertical swipe */
-                swipe_direction = swipe_direction_option::UNDECIDED;
-                touch_x_offset = std::round(touch_x_offset);
-                touch_y_offset = 0.0;
-                flick_timestamp = 0;
-                start_flick = {0, 0};
-                start_touch = {0, 0};
-                layout_slots(get_views());
-            } else
-            {
-                /* Count msec since last hook. Should be frame-length but let's not bet */
-                uint32_t current_time = wf::get_current_time();
-                double count_msec = current_time - flick_timestamp;
-                flick_timestamp = current_time;
-                wf::pointf_t movement = {velocity.x * count_msec, velocity.y * count_msec};
-                handle_relative_motion(movement, current_time);
-            }
-        }
+        bool running = animation_running() || !input.is_velocity_zero();
+        input.step_flick();
 
         if (running)
         {
@@ -1002,9 +2564,13 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
         return output->is_plugin_active(this->grab_interface.name);
     }
 
-    /* Activate and start scale animation */
-    bool activate()
+    /* Activate and start scale animation, optionally overriding the
+     * configured layout engine and the initially selected slot, which is
+     * clamped to the slots there are */
+    bool activate(std::string layout_name = "", long initial_index = -1)
     {
+        activation_start = activation_request.value_or(latency_clock::now());
+        activation_request.reset();
         if (active)
         {
             return false;
@@ -1022,25 +2588,37 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
             return false;
         }
 
-        touch_held = false;
-        swipe_direction = swipe_direction_option::UNDECIDED;
+        input.reset();
+        if (layout_name.empty())
+        {
+            layout_name = layout_option;
+        }
+
+        layout_engine = touchswitch_create_layout(layout_name);
 
         wayfire_toplevel_view active_view = toplevel_cast(wf::get_active_view_for_output(output));
-        if (active_view)
+        if (initial_index >= 0)
+        {
+            input.touch_x_offset = std::min<size_t>(initial_index, views.size() - 1);
+        } else if (active_view)
         {
-            touch_x_offset = get_view_index(active_view);
+            input.touch_x_offset = get_view_index(active_view);
         } else
         {
-            touch_x_offset = 0.0;
+            input.touch_x_offset = 0.0;
         }
 
         /* Make sure no leftover events from the activation binding
            trigger an action in switcher */
         last_selected_view = nullptr;
+        begin_trace(layout_name);
 
         grab->grab_input(wf::scene::layer::WORKSPACE);
 
         active = true;
+        phase  = touchswitch_phase_t::ACTIVE;
+        staging = activation_budget > 0;
+        staging_first_frame = staging;
 
         /* For already visible views, transform from current location */
         for (auto& view : get_views())
@@ -1060,15 +2638,80 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
         touchswitch_update_signal signal;
         output->emit(&signal);
 
+        start_refresh_timers();
+        latency.activate.add(ms_since(activation_start));
+        awaiting_first_frame   = true;
+        awaiting_first_present = false;
         return true;
     }
 
+    /**
+     * Minimize the given views in one pass, bottom of the stack first. Only
+     * the last one can hold the keyboard focus, so focus moves at most once
+     * instead of down through every view being minimized. Views which are
+     * still minimized, because the switcher never showed them, are skipped.
+     */
+    void minimize_views(std::vector<wayfire_toplevel_view> views)
+    {
+        views.erase(std::remove_if(views.begin(), views.end(),
+            [] (auto v) { return v->minimized; }), views.end());
+        if (views.empty())
+        {
+            return;
+        }
+
+        auto start = latency_clock::now();
+        auto stack = output->wset()->get_views(wf::WSET_MAPPED_ONLY | wf::WSET_SORT_STACKING);
+        std::map<wayfire_toplevel_view, size_t> depth;
+        for (size_t i = 0; i < stack.size(); i++)
+        {
+            depth[stack[i]] = i;
+        }
+
+        /* get_views() with stacking order lists the top view first */
+        const auto& get_depth = [&] (wayfire_toplevel_view v)
+        {
+            auto it = depth.find(v);
+            return (it == depth.end()) ? 0 : it->second;
+        };
+        std::stable_sort(views.begin(), views.end(), [&] (auto a, auto b)
+        {
+            return get_depth(a) > get_depth(b);
+        });
+
+        for (auto& v : views)
+        {
+            v->set_minimized(true);
+        }
+
+        stats.minimized_views += views.size();
+        stats.minimize_us += std::chrono::duration_cast<std::chrono::microseconds>(
+            latency_clock::now() - start).count();
+    }
+
     /* Deactivate and start unscale animation */
     void deactivate()
     {
+        if (phase != touchswitch_phase_t::ACTIVE)
+        {
+            return;
+        }
+
+        /* A request noted for an activation that did not happen must not
+         * be taken as the start of a later one */
+        activation_request.reset();
+        /* The selection becomes an index into the unfiltered views */
+        clear_filter();
         auto view = get_current_view();
+        closing_view = view;
+        closing_to_desktop = (view == nullptr);
 
         active = false;
+        phase  = touchswitch_phase_t::CLOSING;
+        trace.close();
+        end_activation_stages();
+        deactivation_start = latency_clock::now();
+        deactivating = true;
 
         set_hook();
         on_view_mapped.disconnect();
@@ -1079,10 +2722,38 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
         grab->ungrab_input();
         output->deactivate_plugin(&grab_interface);
 
+        /* Thumbnails would look blurry growing back to full size */
+        throttle_timer.disconnect();
+        lod_timer.disconnect();
+        live_view = nullptr;
+        for (auto& e : scale_data)
+        {
+            if (!e.first->minimized)
+            {
+                hide_snapshot(e.first);
+            }
+        }
+
+        auto chosen = scale_data.find(view);
+        if ((view != nullptr) && snapshot_nodes.count(view))
+        {
+            /* Only the chosen view is really unminimized */
+            hide_snapshot(view);
+            view->set_minimized(false);
+            if (chosen != scale_data.end())
+            {
+                chosen->second.was_minimized = false;
+            }
+        }
+
         if (view != nullptr)
         {
             wf::get_core().default_wm->focus_raise_view(view);
-            setup_view_transform(view, scale_data[view], 1, 1, 0, 0);
+        }
+
+        if (chosen != scale_data.end())
+        {
+            setup_view_transform(view, chosen->second, 1, 1, 0, 0);
         }
         bool to_desktop = ((std::string)background_action)=="showdesktop" && view == nullptr;
         for (auto& e : scale_data)
@@ -1108,6 +2779,20 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
     /* Completely end switcher, including animation */
     void finalize()
     {
+        if (phase == touchswitch_phase_t::INACTIVE)
+        {
+            /* Nothing to end, e.g. fini() while the switcher is closed */
+            return;
+        }
+
+        if (phase == touchswitch_phase_t::TEARDOWN)
+        {
+            /* Something done below led back here */
+            return;
+        }
+
+        bool was_closing = (phase == touchswitch_phase_t::CLOSING);
+        phase = touchswitch_phase_t::TEARDOWN;
         if (active)
         {
             /* only emit the signal if deactivate() was not called before */
@@ -1115,19 +2800,65 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
             output->emit(&signal);
 
         }
+
+        if (deactivating)
+        {
+            latency.deactivate.add(ms_since(deactivation_start));
+            deactivating = false;
+        }
+
+        awaiting_first_frame   = false;
+        awaiting_first_present = false;
         active = false;
-        auto view = get_current_view();
+        trace.close();
+        end_activation_stages();
+        clear_filter();
+        /* Views may have gone since deactivate(), so the index is stale */
+        auto view = was_closing ? closing_view : get_current_view();
+        bool to_desktop = was_closing ? closing_to_desktop : (view == nullptr);
+        closing_view = nullptr;
         std::string action = background_action;
+
+        /* Stop following the views before focusing and minimizing them */
+        on_view_mapped.disconnect();
+        workspace_changed.disconnect();
+        workarea_changed.disconnect();
+        view_geometry_changed.disconnect();
+
+        if ((view != nullptr) && snapshot_nodes.count(view))
+        {
+            hide_snapshot(view);
+            view->set_minimized(false);
+            auto chosen = scale_data.find(view);
+            if (chosen != scale_data.end())
+            {
+                chosen->second.was_minimized = false;
+            }
+        }
+
+        /* Views still shown from a snapshot go back to being just minimized
+         * or live */
+        while (!snapshot_nodes.empty())
+        {
+            hide_snapshot(snapshot_nodes.begin()->first);
+        }
+
+        live_view = nullptr;
+        throttle_timer.disconnect();
+        lod_timer.disconnect();
+
         if (view != nullptr)
         {
             wf::get_core().default_wm->focus_raise_view(view);
         }
+
+        std::vector<wayfire_toplevel_view> to_minimize;
         for (auto& some_view : get_views())
         {
             /* Perform show desktop action */
-            if (action == "showdesktop" && view == nullptr)
+            if (action == "showdesktop" && to_desktop)
             {
-                some_view->set_minimized(true);
+                to_minimize.push_back(some_view);
                 continue;
             }
             /* Skip newly chosen window */
@@ -1136,25 +2867,127 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
                 continue;
             }
             /* Minimize others if user preference */
-            if (minimize_others || scale_data[some_view].was_minimized)
+            auto it = scale_data.find(some_view);
+            if (minimize_others || ((it != scale_data.end()) && it->second.was_minimized))
             {
-                some_view->set_minimized(true);
+                to_minimize.push_back(some_view);
             }
         }
 
+        minimize_views(to_minimize);
+        transform_batch.commit(output, stats);
         unset_hook();
-        remove_transformers();
+        if (warm_standby)
+        {
+            standby_transformers();
+        } else
+        {
+            remove_transformers();
+            drop_standby();
+        }
+
+        unannounced.clear();
         scale_data.clear();
-        grab->ungrab_input();
-        on_view_mapped.disconnect();
-        workspace_changed.disconnect();
-        workarea_changed.disconnect();
-        view_geometry_changed.disconnect();
-        output->deactivate_plugin(&grab_interface);
-        touch_x_offset = std::numeric_limits<double>::quiet_NaN();
-        touch_y_offset = 0.0;
+        slot_index.clear();
+        slot_index_views.clear();
+        slot_index_dirty = true;
+        animation_clock.reset();
+        log_stats();
+        slot_cache.clear();
+        dirty_slots.clear();
+        last_stats = stats;
+        stats = {};
+        if (!was_closing)
+        {
+            /* deactivate() already released these */
+            grab->ungrab_input();
+            output->deactivate_plugin(&grab_interface);
+        }
+
+        input.reset();
         wf::scene::update(wf::get_core().scene(),
             wf::scene::update_flag::INPUT_STATE);
+        phase = touchswitch_phase_t::INACTIVE;
+    }
+
+    /* Report counters gathered during this activation in the debug log */
+    void log_stats()
+    {
+        if (stats.motion_events > 0)
+        {
+            LOGD("touchswitch: ", stats.motion_events, " motion events, ",
+                stats.layouts, " layouts executed");
+        }
+
+        if (stats.flick_missed_frames > 0)
+        {
+            LOGD("touchswitch: ", stats.flick_missed_frames, " frames missed during flicks");
+        }
+
+        if (stats.flick_predictions > 0)
+        {
+            LOGD("touchswitch: ", stats.flick_predictions_hit, " of ",
+                stats.flick_predictions, " flick landing predictions were correct");
+        }
+
+        if (stats.staged_items > 0)
+        {
+            LOGD("touchswitch: ", stats.staged_items, " activation steps deferred over ",
+                stats.staged_frames, " frames");
+        }
+
+        if (stats.damage_batches > 0)
+        {
+            LOGD("touchswitch: ", stats.damage_batches, " batched transform updates damaged ",
+                stats.damage_batched_area, " px, per-view updates would have damaged ",
+                stats.damage_per_view_area, " px");
+        }
+
+        if (stats.minimized_views > 0)
+        {
+            LOGD("touchswitch: minimized ", stats.minimized_views, " views in ",
+                stats.minimize_us, " us");
+        }
+
+        if (stats.snapshot_slots + stats.unminimized_slots > 0)
+        {
+            LOGD("touchswitch: ", stats.snapshot_slots, " minimized views shown from snapshots, ",
+                stats.unminimized_slots, " unminimized");
+        }
+
+        if (stats.thumbnail_captures > 0)
+        {
+            LOGD("touchswitch: ", stats.thumbnail_captures, " thumbnails captured");
+        }
+
+        if (stats.throttled_refreshes > 0)
+        {
+            LOGD("touchswitch: ", stats.throttled_refreshes, " throttled slot refreshes");
+        }
+
+        if (stats.lod_captures > 0)
+        {
+            LOGD("touchswitch: ", stats.lod_captures, " filtered snapshots captured");
+        }
+
+        if (latency.activate.size() > 0)
+        {
+            LOGD("touchswitch: activation ", latency.activate.last(), " ms, first frame ",
+                latency.first_frame.last(), " ms, first present ", latency.first_present.last(),
+                " ms, deactivation ", latency.deactivate.last(), " ms; p50/p99 of last ",
+                latency.first_present.size(), ": first present ",
+                latency.first_present.quantile(0.5), "/", latency.first_present.quantile(0.99),
+                " ms, deactivation ", latency.deactivate.quantile(0.5), "/",
+                latency.deactivate.quantile(0.99), " ms");
+        }
+
+        uint64_t lookups = stats.slot_cache_hits + stats.slot_cache_misses;
+        if (lookups > 0)
+        {
+            LOGD("touchswitch: slot cache ", stats.slot_cache_hits, " hits, ",
+                stats.slot_cache_misses, " misses (",
+                (100 * stats.slot_cache_hits) / lookups, "% hit rate)");
+        }
     }
 
     /* Utility hook setter */
@@ -1187,6 +3020,14 @@ class wayfire_touchswitch : public wf::per_output_plugin_instance_t,
     void fini() override
     {
         finalize();
+        drop_standby();
+        /* Snapshots are freed by code in this plugin, they cannot outlive it */
+        for (auto& view : wf::get_core().get_all_views())
+        {
+            view->erase_data<touchswitch_snapshot_t>();
+        }
+
+        on_present.disconnect();
         show_title.fini();
         show_icon.fini();
     }
@@ -1196,16 +3037,29 @@ class wayfire_touchswitch_global : public wf::plugin_interface_t,
     public wf::per_output_tracker_mixin_t<wayfire_touchswitch>
 {
     wf::ipc_activator_t activate{"touchswitch/activate"};
+    wf::shared_data::ref_ptr_t<wf::ipc::method_repository_t> ipc_repo;
 
   public:
     void init() override
     {
         this->init_output_tracking();
         activate.set_handler(activate_cb);
+        ipc_repo->register_method("touchswitch/show", show_cb);
+        ipc_repo->register_method("touchswitch/latency", latency_cb);
+        ipc_repo->register_method("touchswitch/jump", jump_cb);
+        ipc_repo->register_method("touchswitch/select", select_cb);
+        ipc_repo->register_method("touchswitch/list-slots", list_slots_cb);
+        ipc_repo->register_method("touchswitch/counters", counters_cb);
     }
 
     void fini() override
     {
+        ipc_repo->unregister_method("touchswitch/show");
+        ipc_repo->unregister_method("touchswitch/latency");
+        ipc_repo->unregister_method("touchswitch/jump");
+        ipc_repo->unregister_method("touchswitch/select");
+        ipc_repo->unregister_method("touchswitch/list-slots");
+        ipc_repo->unregister_method("touchswitch/counters");
         this->fini_output_tracking();
     }
 
@@ -1242,7 +3096,14 @@ class wayfire_touchswitch_global : public wf::plugin_interface_t,
 
     wf::ipc_activator_t::handler_t activate_cb = [=] (wf::output_t *output, wayfire_view)
     {
-        if (this->output_instance[output]->handle_toggle())
+        auto& instance = output_instance[output];
+        if (!instance->active)
+        {
+            /* Toggling it closed is not an activation to time */
+            instance->mark_activation_request();
+        }
+
+        if (instance->handle_toggle())
         {
             output->render->schedule_redraw();
             return true;
@@ -1250,6 +3111,256 @@ class wayfire_touchswitch_global : public wf::plugin_interface_t,
 
         return false;
     };
+
+    /* Find the output an IPC request refers to, the focused one if omitted */
+    wf::output_t *get_ipc_output(const wf::json_t& data)
+    {
+        if (data.has_member("output-id") && data["output-id"].is_int())
+        {
+            return wf::ipc::find_output_by_id(data["output-id"].as_int());
+        }
+
+        return wf::get_core().seat->get_active_output();
+    }
+
+    /* The "index" of an IPC request, -1 if omitted, -2 if invalid */
+    static long get_ipc_index(const wf::json_t& data)
+    {
+        if (!data.has_member("index"))
+        {
+            return -1;
+        }
+
+        if (!data["index"].is_int() || (data["index"].as_int() < 0))
+        {
+            return -2;
+        }
+
+        return data["index"].as_int();
+    }
+
+    /**
+     * IPC method touchswitch/show
+     * Activates the switcher, with an optional "layout" ("carousel" or "grid")
+     * overriding the configured one and an optional initially selected slot
+     * "index", on "output-id" or the focused output.
+     */
+    wf::ipc::method_callback show_cb = [=] (wf::json_t data)
+    {
+        std::string layout = "";
+        if (data.has_member("layout"))
+        {
+            if (!data["layout"].is_string())
+            {
+                return wf::ipc::json_error("layout must be a string");
+            }
+
+            layout = data["layout"].as_string();
+        }
+
+        long index = get_ipc_index(data);
+        if (index == -2)
+        {
+            return wf::ipc::json_error("index must be a non-negative integer");
+        }
+
+        auto output = get_ipc_output(data);
+        if (!output || !output_instance.count(output))
+        {
+            return wf::ipc::json_error("output not found");
+        }
+
+        if (!output_instance[output]->activate(layout, index))
+        {
+            return wf::ipc::json_error("could not activate touchswitch");
+        }
+
+        output->render->schedule_redraw();
+        return wf::ipc::json_ok();
+    };
+
+    /**
+     * IPC method touchswitch/jump
+     * Moves the selection of the running switcher to slot "index" (required),
+     * on "output-id" or the focused output.
+     */
+    wf::ipc::method_callback jump_cb = [=] (wf::json_t data)
+    {
+        long index = get_ipc_index(data);
+        if (index < 0)
+        {
+            return wf::ipc::json_error("index must be a non-negative integer");
+        }
+
+        auto output = get_ipc_output(data);
+        if (!output || !output_instance.count(output))
+        {
+            return wf::ipc::json_error("output not found");
+        }
+
+        if (!output_instance[output]->jump_to_slot(index))
+        {
+            return wf::ipc::json_error("touchswitch is not active or index is out of range");
+        }
+
+        return wf::ipc::json_ok();
+    };
+
+    /**
+     * IPC method touchswitch/select
+     * Switches to slot "index", or the selected slot if omitted, and closes
+     * the running switcher on "output-id" or the focused output.
+     */
+    wf::ipc::method_callback select_cb = [=] (wf::json_t data)
+    {
+        long index = get_ipc_index(data);
+        if (index == -2)
+        {
+            return wf::ipc::json_error("index must be a non-negative integer");
+        }
+
+        auto output = get_ipc_output(data);
+        if (!output || !output_instance.count(output))
+        {
+            return wf::ipc::json_error("output not found");
+        }
+
+        auto& instance = output_instance[output];
+        if (index < 0)
+        {
+            index = instance->get_selected_index();
+        }
+
+        if ((index < 0) || !instance->select_slot(index))
+        {
+            return wf::ipc::json_error("touchswitch is not active or index is out of range");
+        }
+
+        return wf::ipc::json_ok();
+    };
+
+    /**
+     * IPC method touchswitch/list-slots
+     * Lists the slots of the switcher on "output-id" or the focused output in
+     * display order, with the view shown in each, the geometry the slot is
+     * moving to ("target") and where it is now ("geometry"), both relative
+     * to the output.
+     */
+    wf::ipc::method_callback list_slots_cb = [=] (wf::json_t data)
+    {
+        auto output = get_ipc_output(data);
+        if (!output || !output_instance.count(output))
+        {
+            return wf::ipc::json_error("output not found");
+        }
+
+        auto& instance = output_instance[output];
+        auto response  = wf::ipc::json_ok();
+        response["active"]   = instance->active;
+        response["selected"] = (int64_t)instance->get_selected_index();
+        response["slots"]    = instance->describe_slots();
+        return response;
+    };
+
+    /**
+     * IPC method touchswitch/counters
+     * Returns the performance counters of the running activation on
+     * "output-id" or the focused output, or of the last one if it is closed.
+     */
+    wf::ipc::method_callback counters_cb = [=] (wf::json_t data)
+    {
+        auto output = get_ipc_output(data);
+        if (!output || !output_instance.count(output))
+        {
+            return wf::ipc::json_error("output not found");
+        }
+
+        auto& stats   = output_instance[output]->get_counters();
+        auto response = wf::ipc::json_ok();
+        response["active"] = output_instance[output]->active;
+        response["slot-cache-hits"]       = (int64_t)stats.slot_cache_hits;
+        response["slot-cache-misses"]     = (int64_t)stats.slot_cache_misses;
+        response["damage-batches"]        = (int64_t)stats.damage_batches;
+        response["damage-batched-area"]   = (int64_t)stats.damage_batched_area;
+        response["damage-per-view-area"]  = (int64_t)stats.damage_per_view_area;
+        response["flick-predictions"]     = (int64_t)stats.flick_predictions;
+        response["flick-predictions-hit"] = (int64_t)stats.flick_predictions_hit;
+        response["flick-missed-frames"]   = (int64_t)stats.flick_missed_frames;
+        response["motion-events"] = (int64_t)stats.motion_events;
+        response["layouts"]       = (int64_t)stats.layouts;
+        response["staged-items"]  = (int64_t)stats.staged_items;
+        response["staged-frames"] = (int64_t)stats.staged_frames;
+        response["minimized-views"] = (int64_t)stats.minimized_views;
+        response["minimize-us"]     = (int64_t)stats.minimize_us;
+        response["snapshot-slots"]  = (int64_t)stats.snapshot_slots;
+        response["unminimized-slots"] = (int64_t)stats.unminimized_slots;
+        response["thumbnail-captures"] = (int64_t)stats.thumbnail_captures;
+        response["throttled-refreshes"] = (int64_t)stats.throttled_refreshes;
+        response["lod-captures"] = (int64_t)stats.lod_captures;
+        return response;
+    };
+
+    static wf::json_t histogram_to_json(const touchswitch_latency_histogram_t& histogram)
+    {
+        wf::json_t result;
+        result["total"] = (int64_t)histogram.get_total();
+        result["count"] = (int64_t)histogram.size();
+        result["last"]  = histogram.last();
+        result["p50"]   = histogram.quantile(0.5);
+        result["p90"]   = histogram.quantile(0.9);
+        result["p99"]   = histogram.quantile(0.99);
+        result["max"]   = histogram.quantile(1.0);
+        wf::json_t buckets = wf::json_t::array();
+        for (size_t i = 0; i < touchswitch_latency_histogram_t::BUCKETS; i++)
+        {
+            wf::json_t bucket;
+            if (std::isfinite(touchswitch_latency_histogram_t::bucket_bound(i)))
+            {
+                bucket["max"] = touchswitch_latency_histogram_t::bucket_bound(i);
+            }
+
+            bucket["count"] = (int64_t)histogram.bucket(i);
+            buckets.append(bucket);
+        }
+
+        result["buckets"] = buckets;
+        return result;
+    }
+
+    /**
+     * IPC method touchswitch/latency
+     * Returns the activation latency histograms, in milliseconds, of
+     * "output-id" or of every output. Each covers the most recent
+     * activations: "activate" until activate() returned, "first-frame" until
+     * the first frame was rendered, "first-present" until it was shown, and
+     * "deactivate" from deactivation until the switcher was torn down.
+     */
+    wf::ipc::method_callback latency_cb = [=] (wf::json_t data)
+    {
+        wf::json_t outputs = wf::json_t::array();
+        for (auto& [output, instance] : output_instance)
+        {
+            if (data.has_member("output-id") && data["output-id"].is_int() &&
+                ((int64_t)output->get_id() != data["output-id"].as_int()))
+            {
+                continue;
+            }
+
+            auto& latency = instance->latency;
+            wf::json_t entry;
+            entry["output-id"]     = (int64_t)output->get_id();
+            entry["name"]          = output->to_string();
+            entry["activate"]      = histogram_to_json(latency.activate);
+            entry["first-frame"]   = histogram_to_json(latency.first_frame);
+            entry["first-present"] = histogram_to_json(latency.first_present);
+            entry["deactivate"]    = histogram_to_json(latency.deactivate);
+            outputs.append(entry);
+        }
+
+        auto response = wf::ipc::json_ok();
+        response["outputs"] = outputs;
+        return response;
+    };
 };
 
 DECLARE_WAYFIRE_PLUGIN(wayfire_touchswitch_global);
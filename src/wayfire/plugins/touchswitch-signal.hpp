@@ -45,4 +45,32 @@ struct touchswitch_transformer_removed_signal
     wayfire_toplevel_view view;
 };
 
+/**
+ * name: touchswitch-transformer-standby
+ * on: output
+ * when: Touchswitch is about to detach the transformer of a view, but keeps it
+ *   for the next activation (touchswitch/warm_standby). Plugins should take
+ *   their overlay nodes out of the scene and keep them, and put them back on
+ *   the next touchswitch-transformer-added for the view. If the view leaves
+ *   standby for good, touchswitch-transformer-removed is emitted instead.
+ * argument: the view whose transformer goes into standby
+ */
+struct touchswitch_transformer_standby_signal
+{
+    wayfire_toplevel_view view;
+};
+
+/**
+ * name: touchswitch-prefetch
+ * on: output
+ * when: Touchswitch predicts that the given view is about to become the
+ *   selected slot, for example where a flick is going to stop. Plugins
+ *   extending touchswitch can load expensive resources for it ahead of time.
+ * argument: the view which is about to be selected
+ */
+struct touchswitch_prefetch_signal
+{
+    wayfire_toplevel_view view;
+};
+
 #endif